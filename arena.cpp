@@ -0,0 +1,147 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+using namespace calc;
+
+namespace
+{
+    thread_local arena *activeArena = nullptr;
+}
+
+arena::arena(size_t _chunkSize)
+    : chunkSize(std::max<size_t>(_chunkSize, 4096))
+{
+    activate(nullptr);
+}
+
+arena::~arena()
+{
+    notify();
+    if (activeArena == this)
+        activeArena = nullptr;
+    while (first)
+    {
+        chunk *next = first->next;
+        std::free(first);
+        first = next;
+    }
+}
+
+void arena::activate(chunk *target)
+{
+    if (!target)
+    {
+        // first chunk is created lazily by the slow path
+        cursor = limit = nullptr;
+        active = nullptr;
+        usedBefore = 0;
+        return;
+    }
+    active = target;
+    cursor = target->data();
+    limit = cursor + target->size;
+}
+
+void *arena::allocateSlow(size_t size, size_t alignment)
+{
+    if (active)
+        usedBefore += cursor - active->data();
+    // reuse chunks kept from previous queries before asking the system
+    chunk *candidate = active ? active->next : first;
+    if (!candidate || candidate->size < size + alignment)
+    {
+        size_t request = std::max(chunkSize, size + alignment);
+        candidate = static_cast<chunk *>(std::malloc(sizeof(chunk) + request));
+        if (!candidate)
+            throw std::bad_alloc();
+        candidate->size = request;
+        if (active)
+        {
+            candidate->next = active->next;
+            active->next = candidate;
+        }
+        else
+        {
+            candidate->next = first;
+            first = candidate;
+        }
+    }
+    activate(candidate);
+    return allocate(size, alignment);
+}
+
+void arena::release()
+{
+    notify();
+    if (first)
+        activate(first);
+    usedBefore = 0;
+    std::fill(std::begin(recycled), std::end(recycled), nullptr);
+}
+
+void arena::shrink()
+{
+    if (!first)
+        return;
+    chunk *extra = first->next;
+    while (extra)
+    {
+        chunk *next = extra->next;
+        std::free(extra);
+        extra = next;
+    }
+    first->next = nullptr;
+    release();
+}
+
+size_t arena::bytesUsed() const
+{
+    return usedBefore + (active ? cursor - active->data() : 0);
+}
+
+size_t arena::bytesReserved() const
+{
+    size_t total = 0;
+    for (chunk *it = first; it; it = it->next)
+        total += it->size;
+    return total;
+}
+
+void arena::subscribe(listener &watcher)
+{
+    listeners.push_back(&watcher);
+}
+
+void arena::unsubscribe(listener &watcher)
+{
+    listeners.erase(std::remove(listeners.begin(), listeners.end(), &watcher), listeners.end());
+}
+
+void arena::notify()
+{
+    // listeners may unsubscribe while they are told
+    const std::vector<listener *> told = listeners;
+    for (listener *watcher : told)
+        watcher->released(*this);
+}
+
+arena *arena::current()
+{
+    return activeArena;
+}
+
+arena::scope::scope(arena &_owner, const bool _release)
+    : owner(_owner), previous(activeArena), releaseOnExit(_release)
+{
+    activeArena = &owner;
+}
+
+arena::scope::~scope()
+{
+    activeArena = previous;
+    if (releaseOnExit)
+        owner.release();
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace calc
+{
+    // bump allocator owning every node created during one proof or query
+    // allocation moves a cursor through large chunks, small blocks given back by temporaries are recycled
+    // release() rewinds to the first chunk in O(1) and keeps the chunks for the next query
+    class arena
+    {
+    public:
+        static constexpr size_t defaultChunkSize = size_t(1) << 20;
+        // recycled blocks come in exact classes of granularity bytes up to smallLimit,
+        // larger ones are rounded up to a power of two
+        static constexpr size_t granularity = 16;
+        static constexpr size_t smallLimit = 512;
+        static constexpr size_t sizeClasses = smallLimit / granularity + 16;
+
+        explicit arena(size_t _chunkSize = defaultChunkSize);
+        ~arena();
+
+        arena(const arena &) = delete;
+        arena &operator=(const arena &) = delete;
+
+        void *allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+        {
+            const size_t sizeClass = classOf(size);
+            if (sizeClass < sizeClasses && alignment <= granularity)
+            {
+                if (freeBlock *block = recycled[sizeClass])
+                {
+                    recycled[sizeClass] = block->next;
+                    return block;
+                }
+                size = classSize(sizeClass);
+            }
+            uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~uintptr_t(alignment - 1);
+            if (aligned + size > reinterpret_cast<uintptr_t>(limit))
+                return allocateSlow(size, alignment);
+            cursor = reinterpret_cast<char *>(aligned + size);
+            return reinterpret_cast<void *>(aligned);
+        }
+
+        // keeps a block for reuse by later allocations of the same class
+        void recycle(void *ptr, size_t size)
+        {
+            const size_t sizeClass = classOf(size);
+            if (sizeClass >= sizeClasses)
+                return;
+            freeBlock *block = static_cast<freeBlock *>(ptr);
+            block->next = recycled[sizeClass];
+            recycled[sizeClass] = block;
+        }
+
+        void release();
+        void shrink(); // returns every chunk but the first to the system
+
+        size_t bytesUsed() const;
+        size_t bytesReserved() const;
+
+        // tables holding pointers into the arena, told before it releases its nodes and before it is destroyed
+        class listener
+        {
+        public:
+            virtual void released(arena &owner) = 0;
+
+        protected:
+            ~listener() {}
+        };
+
+        // a listener stays subscribed across releases until it unsubscribes, which it may do from released()
+        void subscribe(listener &watcher);
+        void unsubscribe(listener &watcher);
+
+        // arena receiving the nodes of the running thread, nullptr outside of any query
+        static arena *current();
+
+        // activates an arena for the lifetime of a query and releases it afterwards
+        // with _release = false the nodes stay in the arena, for results that outlive the scope
+        class scope
+        {
+        public:
+            explicit scope(arena &_owner, const bool _release = true);
+            ~scope();
+
+            scope(const scope &) = delete;
+            scope &operator=(const scope &) = delete;
+
+        private:
+            arena &owner;
+            arena *previous;
+            const bool releaseOnExit;
+        };
+
+    private:
+        struct chunk
+        {
+            chunk *next;
+            size_t size;
+            char *data() { return reinterpret_cast<char *>(this + 1); }
+        };
+
+        struct freeBlock
+        {
+            freeBlock *next;
+        };
+
+        static size_t classOf(size_t size)
+        {
+            if (size <= smallLimit)
+                return (size + granularity - 1) / granularity - (size != 0);
+            return smallLimit / granularity + (63 - __builtin_clzll((size - 1) / smallLimit));
+        }
+        static size_t classSize(size_t sizeClass)
+        {
+            if (sizeClass < smallLimit / granularity)
+                return (sizeClass + 1) * granularity;
+            return smallLimit << (sizeClass - smallLimit / granularity + 1);
+        }
+
+        void *allocateSlow(size_t size, size_t alignment);
+        void activate(chunk *target);
+        void notify();
+
+        size_t chunkSize;
+        chunk *first = nullptr;
+        chunk *active = nullptr;
+        char *cursor = nullptr;
+        char *limit = nullptr;
+        size_t usedBefore = 0; // bytes consumed in chunks preceding the active one
+        freeBlock *recycled[sizeClasses] = {};
+        std::vector<listener *> listeners;
+    };
+
+    // memory for nodes: taken from the active arena, from the heap otherwise
+    inline void *allocateNode(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+        if (arena *owner = arena::current())
+            return owner->allocate(size, alignment);
+        return ::operator new(size);
+    }
+
+    // arena memory is reclaimed with the whole query, only heap memory is freed here
+    inline void deallocateNode(void *ptr)
+    {
+        if (!arena::current())
+            ::operator delete(ptr);
+    }
+
+    // allocator for node-owned containers
+    // remembers where its memory came from, so a container may safely outlive a change of the active arena
+    template <class T>
+    class arenaAllocator
+    {
+    public:
+        using value_type = T;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        arenaAllocator() : source(arena::current()) {}
+        template <class U>
+        arenaAllocator(const arenaAllocator<U> &other) : source(other.source) {}
+
+        T *allocate(size_t n)
+        {
+            if (source)
+                return static_cast<T *>(source->allocate(n * sizeof(T), alignof(T)));
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+        void deallocate(T *ptr, size_t n)
+        {
+            if (source)
+                source->recycle(ptr, n * sizeof(T));
+            else
+                ::operator delete(ptr);
+        }
+
+        // copies of a container belong to the query that makes them
+        arenaAllocator select_on_container_copy_construction() const { return arenaAllocator(); }
+
+        template <class U>
+        bool operator==(const arenaAllocator<U> &other) const { return source == other.source; }
+        template <class U>
+        bool operator!=(const arenaAllocator<U> &other) const { return source != other.source; }
+
+    private:
+        template <class U>
+        friend class arenaAllocator;
+
+        arena *source;
+    };
+
+    template <class T>
+    using arenaVector = std::vector<T, arenaAllocator<T>>;
+}
@@ -0,0 +1,216 @@
+#include "batch.h"
+
+#include <cmath>
+#include <limits>
+
+#include <immintrin.h>
+
+using namespace calc;
+
+namespace
+{
+    using opcode = straightLineProgram::opcode;
+
+// vectors only pass between functions that end up inlined into one kernel, no call crosses the ABI boundary gcc warns about
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+    // lane-wise double arithmetic, one set per instruction set; the vector ones are only called
+    // from kernels compiled for their target, which they are inlined into
+    struct scalarLanes
+    {
+        static constexpr size_t width = 1;
+        using vec = double;
+        static vec load(const double *a) { return *a; }
+        static void store(double *a, vec x) { *a = x; }
+        static vec broadcast(double x) { return x; }
+        static vec add(vec x, vec y) { return x + y; }
+        static vec sub(vec x, vec y) { return x - y; }
+        static vec mul(vec x, vec y) { return x * y; }
+        static vec div(vec x, vec y) { return x / y; }
+        static uint64_t zeroLanes(vec x) { return x == 0; }
+    };
+
+    struct avx2Lanes
+    {
+        static constexpr size_t width = 4;
+        using vec = __m256d;
+        __attribute__((target("avx2"))) static vec load(const double *a) { return _mm256_loadu_pd(a); }
+        __attribute__((target("avx2"))) static void store(double *a, vec x) { _mm256_storeu_pd(a, x); }
+        __attribute__((target("avx2"))) static vec broadcast(double x) { return _mm256_set1_pd(x); }
+        __attribute__((target("avx2"))) static vec add(vec x, vec y) { return _mm256_add_pd(x, y); }
+        __attribute__((target("avx2"))) static vec sub(vec x, vec y) { return _mm256_sub_pd(x, y); }
+        __attribute__((target("avx2"))) static vec mul(vec x, vec y) { return _mm256_mul_pd(x, y); }
+        __attribute__((target("avx2"))) static vec div(vec x, vec y) { return _mm256_div_pd(x, y); }
+        __attribute__((target("avx2"))) static uint64_t zeroLanes(vec x) { return _mm256_movemask_pd(_mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_EQ_OQ)); }
+    };
+
+    struct avx512Lanes
+    {
+        static constexpr size_t width = 8;
+        using vec = __m512d;
+        __attribute__((target("avx512f"))) static vec load(const double *a) { return _mm512_loadu_pd(a); }
+        __attribute__((target("avx512f"))) static void store(double *a, vec x) { _mm512_storeu_pd(a, x); }
+        __attribute__((target("avx512f"))) static vec broadcast(double x) { return _mm512_set1_pd(x); }
+        __attribute__((target("avx512f"))) static vec add(vec x, vec y) { return _mm512_add_pd(x, y); }
+        __attribute__((target("avx512f"))) static vec sub(vec x, vec y) { return _mm512_sub_pd(x, y); }
+        __attribute__((target("avx512f"))) static vec mul(vec x, vec y) { return _mm512_mul_pd(x, y); }
+        __attribute__((target("avx512f"))) static vec div(vec x, vec y) { return _mm512_div_pd(x, y); }
+        __attribute__((target("avx512f"))) static uint64_t zeroLanes(vec x) { return _mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_EQ_OQ); }
+    };
+
+    static_assert(batchEvaluator::blockSize % avx512Lanes::width == 0 && batchEvaluator::blockSize <= 64);
+
+    // one instruction at a time over the whole block, registers as in batchEvaluator::re() and im()
+    template <class lanes>
+    __attribute__((always_inline)) inline uint64_t evaluateBlockWith(const straightLineProgram &program, double *scratch,
+                                                                    const complexPlanes *inputs, size_t first, size_t used)
+    {
+        using vec = typename lanes::vec;
+        constexpr size_t blockSize = batchEvaluator::blockSize, width = lanes::width;
+        auto re = [scratch](uint32_t reg)
+        { return scratch + 2 * reg * blockSize; };
+        auto im = [scratch](uint32_t reg)
+        { return scratch + (2 * reg + 1) * blockSize; };
+        uint64_t vanished = 0;
+        for (const straightLineProgram::instruction &step : program.code())
+        {
+            double *outRe = re(step.target), *outIm = im(step.target);
+            switch (step.op)
+            {
+            case opcode::CONSTANT:
+            {
+                const constTy value = program.constants()[step.left];
+                for (size_t lane = 0; lane < blockSize; lane += width)
+                {
+                    lanes::store(outRe + lane, lanes::broadcast(value.real()));
+                    lanes::store(outIm + lane, lanes::broadcast(value.imag()));
+                }
+                break;
+            }
+            case opcode::LOAD:
+            {
+                // lanes past the last point read ones, they are never reported but must not divide by zero
+                const complexPlanes &term = inputs[step.left];
+                std::copy(term.re + first, term.re + first + used, outRe);
+                std::copy(term.im + first, term.im + first + used, outIm);
+                std::fill(outRe + used, outRe + blockSize, 1.0);
+                std::fill(outIm + used, outIm + blockSize, 0.0);
+                break;
+            }
+            case opcode::CONJ:
+            {
+                const double *xRe = re(step.left), *xIm = im(step.left);
+                for (size_t lane = 0; lane < blockSize; lane += width)
+                {
+                    lanes::store(outRe + lane, lanes::load(xRe + lane));
+                    lanes::store(outIm + lane, lanes::sub(lanes::broadcast(0), lanes::load(xIm + lane)));
+                }
+                break;
+            }
+            case opcode::ADD:
+            case opcode::SUB:
+            {
+                const bool subtract = step.op == opcode::SUB;
+                const double *xRe = re(step.left), *xIm = im(step.left), *yRe = re(step.right), *yIm = im(step.right);
+                for (size_t lane = 0; lane < blockSize; lane += width)
+                {
+                    const vec ar = lanes::load(xRe + lane), ai = lanes::load(xIm + lane), br = lanes::load(yRe + lane), bi = lanes::load(yIm + lane);
+                    lanes::store(outRe + lane, subtract ? lanes::sub(ar, br) : lanes::add(ar, br));
+                    lanes::store(outIm + lane, subtract ? lanes::sub(ai, bi) : lanes::add(ai, bi));
+                }
+                break;
+            }
+            case opcode::MUL:
+            {
+                const double *xRe = re(step.left), *xIm = im(step.left), *yRe = re(step.right), *yIm = im(step.right);
+                for (size_t lane = 0; lane < blockSize; lane += width)
+                {
+                    const vec ar = lanes::load(xRe + lane), ai = lanes::load(xIm + lane), br = lanes::load(yRe + lane), bi = lanes::load(yIm + lane);
+                    lanes::store(outRe + lane, lanes::sub(lanes::mul(ar, br), lanes::mul(ai, bi)));
+                    lanes::store(outIm + lane, lanes::add(lanes::mul(ar, bi), lanes::mul(ai, br)));
+                }
+                break;
+            }
+            case opcode::DIV:
+            {
+                const double *xRe = re(step.left), *xIm = im(step.left), *yRe = re(step.right), *yIm = im(step.right);
+                for (size_t lane = 0; lane < blockSize; lane += width)
+                {
+                    const vec ar = lanes::load(xRe + lane), ai = lanes::load(xIm + lane), br = lanes::load(yRe + lane), bi = lanes::load(yIm + lane);
+                    const vec norm = lanes::add(lanes::mul(br, br), lanes::mul(bi, bi));
+                    vanished |= lanes::zeroLanes(norm) << lane;
+                    lanes::store(outRe + lane, lanes::div(lanes::add(lanes::mul(ar, br), lanes::mul(ai, bi)), norm));
+                    lanes::store(outIm + lane, lanes::div(lanes::sub(lanes::mul(ai, br), lanes::mul(ar, bi)), norm));
+                }
+                break;
+            }
+            }
+        }
+        return used == blockSize ? vanished : vanished & ((uint64_t(1) << used) - 1);
+    }
+
+#pragma GCC diagnostic pop
+
+    uint64_t scalarBlock(const straightLineProgram &program, double *scratch, const complexPlanes *inputs, size_t first, size_t used)
+    {
+        return evaluateBlockWith<scalarLanes>(program, scratch, inputs, first, used);
+    }
+
+    __attribute__((target("avx2"))) uint64_t avx2Block(const straightLineProgram &program, double *scratch,
+                                                       const complexPlanes *inputs, size_t first, size_t used)
+    {
+        return evaluateBlockWith<avx2Lanes>(program, scratch, inputs, first, used);
+    }
+
+    __attribute__((target("avx512f"))) uint64_t avx512Block(const straightLineProgram &program, double *scratch,
+                                                            const complexPlanes *inputs, size_t first, size_t used)
+    {
+        return evaluateBlockWith<avx512Lanes>(program, scratch, inputs, first, used);
+    }
+
+    using blockKernel = uint64_t (*)(const straightLineProgram &, double *, const complexPlanes *, size_t, size_t);
+
+    // the widest kernel the processor running the program supports
+    blockKernel fastestKernel()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return avx512Block;
+        if (__builtin_cpu_supports("avx2"))
+            return avx2Block;
+        return scalarBlock;
+    }
+}
+
+batchEvaluator::batchEvaluator(const straightLineProgram &_program)
+    : program(_program), scratch(2 * _program.registerCount() * blockSize)
+{
+}
+
+size_t batchEvaluator::evaluate(const complexPlanes *inputs, size_t count, double *outRe, double *outIm, uint8_t *singular)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const uint32_t result = program.resultRegister();
+    size_t singularCount = 0;
+    for (size_t first = 0; first < count; first += blockSize)
+    {
+        const size_t used = std::min(blockSize, count - first);
+        const uint64_t vanished = evaluateBlock(inputs, first, used);
+        for (size_t lane = 0; lane < used; ++lane)
+        {
+            const bool bad = (vanished >> lane) & 1;
+            outRe[first + lane] = bad ? nan : re(result)[lane];
+            outIm[first + lane] = bad ? nan : im(result)[lane];
+            singular[first + lane] = bad;
+            singularCount += bad;
+        }
+    }
+    return singularCount;
+}
+
+uint64_t batchEvaluator::evaluateBlock(const complexPlanes *inputs, size_t first, size_t used)
+{
+    static const blockKernel kernel = fastestKernel();
+    return kernel(program, scratch.data(), inputs, first, used);
+}
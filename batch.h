@@ -0,0 +1,44 @@
+#pragma once
+
+#include "straightline.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace calc
+{
+    // complex values of one term at every sample point, real and imaginary parts in separate arrays
+    struct complexPlanes
+    {
+        const double *re;
+        const double *im;
+    };
+
+    // evaluates a straight-line program (see straightline.h) at many points at once
+    // points are processed in blocks of blockSize, one instruction at a time over the whole block,
+    // with AVX-512 or AVX2 kernels where the processor has them, chosen once at run time, and plain loops otherwise
+    // the scratch block is allocated once, evaluation itself does not allocate
+    class batchEvaluator
+    {
+    public:
+        static constexpr size_t blockSize = 64;
+
+        explicit batchEvaluator(const straightLineProgram &_program);
+
+        // inputs has program.inputCount() entries indexed by slot, only program.inputSlots() are read,
+        // every read array holds count points; unit terms are expected on the unit circle, their conj is 1/z
+        // singular[i] is set where a denominator vanishes at point i, and the output there is NaN
+        // returns the number of singular points
+        size_t evaluate(const complexPlanes *inputs, size_t count, double *outRe, double *outIm, uint8_t *singular);
+
+    private:
+        const straightLineProgram &program;
+        std::vector<double> scratch; // registers as planes of blockSize real parts followed by blockSize imaginary parts
+
+        // evaluates points [first, first + used), returns a bit per point of the block with a vanishing denominator
+        uint64_t evaluateBlock(const complexPlanes *inputs, size_t first, size_t used);
+        double *re(uint32_t reg) { return scratch.data() + 2 * reg * blockSize; }
+        double *im(uint32_t reg) { return scratch.data() + (2 * reg + 1) * blockSize; }
+    };
+}
@@ -0,0 +1,316 @@
+#include "calculator.h"
+#include "construction.h"
+#include "hashcons.h"
+#include "metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace calc;
+
+// the theorems of geometry.cpp as named benchmark cases, and n-gon families to watch how the work scales
+// every case runs in a child process, so its peak RSS is its own
+// g++ -O2 benchmark.cpp construction.cpp calculator.cpp arena.cpp exponents.cpp parallel.cpp modular.cpp gcd.cpp rational.cpp hashcons.cpp zerotest.cpp metrics.cpp serializer.cpp encoding.cpp resultcache.cpp -pthread -o benchmark
+// ./benchmark [--fast] [--repeat k] [--metrics] [case[:n] ...]      without cases every case runs at its default sizes,
+// --metrics prints the counters of metrics.h under every case
+
+namespace
+{
+	struct benchmarkCase
+	{
+		const char *name;
+		std::vector<unsigned> sizes; // empty for cases of a fixed size
+		std::function<bool(unsigned)> run;
+	};
+
+	std::vector<expr> unitPoints(const char *prefix, unsigned n)
+	{
+		std::vector<expr> points;
+		for (unsigned k = 1; k <= n; ++k)
+			points.push_back(make_unit_term(prefix + std::to_string(k)));
+		return points;
+	}
+
+	expr centroid(const std::vector<expr> &points, size_t first, size_t last)
+	{
+		expr total = points[first];
+		for (size_t k = first + 1; k < last; ++k)
+			total = total->add(points[k]);
+		return total->divide(make_scalar(int(last - first)));
+	}
+
+	bool pascal(unsigned)
+	{
+		auto a = make_unit_term("a");
+		auto b = make_unit_term("b");
+		auto c = make_unit_term("c");
+		auto d = make_unit_term("d");
+		auto e = make_unit_term("e");
+		auto f = make_unit_term("f");
+		expr first = intersect(chord(a, e), chord(b, f));
+		expr second = intersect(chord(c, e), chord(b, d));
+		expr third = intersect(chord(c, f), chord(a, d));
+		return isZero(collinearity(first, second, third));
+	}
+
+	bool brianchon(unsigned)
+	{
+		auto a = make_unit_term("a");
+		auto b = make_unit_term("b");
+		auto c = make_unit_term("c");
+		auto d = make_unit_term("d");
+		auto e = make_unit_term("e");
+		auto f = make_unit_term("f");
+		line A = tangent(a);
+		line B = tangent(b);
+		line C = tangent(c);
+		line D = tangent(d);
+		line E = tangent(e);
+		line F = tangent(f);
+		line first = by_two(intersect(A, B), intersect(E, D));
+		line second = by_two(intersect(B, C), intersect(E, F));
+		line third = by_two(intersect(C, D), intersect(A, F));
+		return isZero(concurrence(first, second, third));
+	}
+
+	bool brianchonPartial(unsigned)
+	{
+		auto a = make_unit_term("a");
+		auto b = make_unit_term("b");
+		auto c = make_unit_term("c");
+		auto d = make_unit_term("d");
+		line A = tangent(a);
+		line B = tangent(b);
+		line C = tangent(c);
+		line D = tangent(d);
+		auto X = intersect(A, B);
+		auto Y = intersect(B, C);
+		auto Z = intersect(C, D);
+		auto T = intersect(D, A);
+		return isZero(concurrence(by_two(X, Z), by_two(Y, T), chord(a, c)));
+	}
+
+	bool orthocenter(unsigned)
+	{
+		auto a = make_unit_term("a");
+		auto b = make_unit_term("b");
+		auto c = make_unit_term("c");
+		line AHa = by_two(a, b->multiply(c)->divide(a)->negate());
+		line BHb = by_two(b, c->multiply(a)->divide(b)->negate());
+		line CHc = by_two(c, a->multiply(b)->divide(c)->negate());
+		return isZero(concurrence(AHa, BHb, CHc));
+	}
+
+	bool medians(unsigned)
+	{
+		auto a = make_term("a");
+		auto b = make_term("b");
+		auto c = make_term("c");
+		line AMa = by_two(a, middlepoint(b, c));
+		line BMb = by_two(b, middlepoint(a, c));
+		line CMc = by_two(c, middlepoint(a, b));
+		return isZero(concurrence(AMa, BMb, CMc));
+	}
+
+	bool squares(unsigned)
+	{
+		auto a = make_unit_term("a");
+		auto b = make_unit_term("b");
+		auto c = make_unit_term("c");
+		auto d = make_unit_term("d");
+		auto X = rot_homothety(a, b, make_scalar(constTy(1, 1))->divide(make_scalar(2)));
+		auto Y = rot_homothety(b, c, make_scalar(constTy(1, 1))->divide(make_scalar(2)));
+		auto Z = rot_homothety(c, d, make_scalar(constTy(1, 1))->divide(make_scalar(2)));
+		auto T = rot_homothety(d, a, make_scalar(constTy(1, 1))->divide(make_scalar(2)));
+		return isZero((X->substract(Z)->multiply(make_scalar(constTy(0, 1))))->substract(T->substract(Y)));
+	}
+
+	// n points on the unit circle: the line through the centroid-like point (S - a_i - a_j) / 2
+	// perpendicular to the chord a_i a_j passes through S / 2, S being the sum of the points
+	bool anticenter(unsigned n)
+	{
+		n = std::max(n, 4u);
+		std::vector<expr> a = unitPoints("a", n);
+		expr total = centroid(a, 0, n)->multiply(make_scalar(int(n)));
+		auto maltitude = [&](size_t i, size_t j)
+		{
+			expr foot = total->substract(a[i])->substract(a[j])->divide(make_scalar(2));
+			return by_two(foot, rotate90(foot, foot->add(a[j])->substract(a[i])));
+		};
+		return isZero(concurrence(maltitude(0, 1), maltitude(1, 2), maltitude(2, 3)));
+	}
+
+	// n plain points: the centroids of the two halves and of all points are collinear
+	bool centroids(unsigned n)
+	{
+		n = std::max(n, 2u);
+		std::vector<expr> p;
+		for (unsigned k = 1; k <= n; ++k)
+			p.push_back(make_term("p" + std::to_string(k)));
+		return isZero(collinearity(centroid(p, 0, n / 2), centroid(p, 0, n), centroid(p, n / 2, n)));
+	}
+
+	const std::vector<benchmarkCase> cases = {
+		{"pascal", {}, pascal},
+		{"brianchon", {}, brianchon},
+		{"brianchon_partial", {}, brianchonPartial},
+		{"orthocenter", {}, orthocenter},
+		{"medians", {}, medians},
+		{"squares", {}, squares},
+		{"anticenter", {4, 6, 8, 12, 16}, anticenter},
+		{"centroids", {4, 8, 16, 32, 64}, centroids},
+	};
+
+	struct measurement
+	{
+		bool holds;
+		double seconds;   // best of the repetitions
+		long peakKilobytes;
+		metricsReport counted; // of the fastest repetition
+	};
+
+	measurement measure(const benchmarkCase &benchmark, unsigned n, unsigned repeat)
+	{
+		measurement result = {};
+		for (unsigned round = 0; round < repeat; ++round)
+		{
+			metrics counters;
+			metrics::scope counting(counters);
+			arena caseArena;
+			arena::scope query(caseArena);
+			nodeCache shared;
+			nodeCache::scope sharing(shared);
+			const auto start = std::chrono::steady_clock::now();
+			result.holds = benchmark.run(n);
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (round == 0 || seconds < result.seconds)
+			{
+				result.seconds = seconds;
+				result.counted = counters.report();
+			}
+		}
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		result.peakKilobytes = usage.ru_maxrss;
+		return result;
+	}
+
+	// in a child process, or in this one if it cannot fork
+	measurement measureIsolated(const benchmarkCase &benchmark, unsigned n, unsigned repeat)
+	{
+		int channel[2];
+		if (pipe(channel) != 0)
+			return measure(benchmark, n, repeat);
+		const pid_t child = fork();
+		if (child < 0)
+		{
+			close(channel[0]);
+			close(channel[1]);
+			return measure(benchmark, n, repeat);
+		}
+		if (child == 0)
+		{
+			close(channel[0]);
+			const measurement result = measure(benchmark, n, repeat);
+			const bool written = write(channel[1], &result, sizeof(result)) == sizeof(result);
+			_exit(written ? 0 : 1);
+		}
+		close(channel[1]);
+		measurement result = {};
+		const bool received = read(channel[0], &result, sizeof(result)) == sizeof(result);
+		close(channel[0]);
+		int status;
+		waitpid(child, &status, 0);
+		if (!received)
+			result.seconds = -1;
+		return result;
+	}
+
+	void report(const benchmarkCase &benchmark, unsigned n, unsigned repeat, bool detailed)
+	{
+		const measurement result = measureIsolated(benchmark, n, repeat);
+		const std::string name = benchmark.sizes.empty() ? benchmark.name : benchmark.name + (":" + std::to_string(n));
+		if (result.seconds < 0)
+		{
+			std::printf("%-20s crashed\n", name.c_str());
+			return;
+		}
+		std::printf("%-20s %-6s %12.6f %12ld %12llu %12llu\n", name.c_str(), result.holds ? "holds" : "FAILS", result.seconds,
+					result.peakKilobytes, (unsigned long long)result.counted.nodesAllocated,
+					(unsigned long long)result.counted.largestPolynomial);
+		std::fflush(stdout);
+		if (detailed)
+		{
+			result.counted.print(std::cout);
+			std::cout << std::endl;
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned repeat = 1;
+	bool detailed = false;
+	checkOptions checks;
+	std::vector<std::pair<const benchmarkCase *, std::vector<unsigned>>> selected;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string argument = argv[i];
+		if (argument == "--fast")
+		{
+			checks.fastChecks = true;
+			continue;
+		}
+		if (argument == "--metrics")
+		{
+			detailed = true;
+			continue;
+		}
+		if (argument == "--repeat" && i + 1 < argc)
+		{
+			repeat = std::max(1, std::atoi(argv[++i]));
+			continue;
+		}
+		const size_t colon = argument.find(':');
+		const std::string name = argument.substr(0, colon);
+		const benchmarkCase *found = nullptr;
+		for (const benchmarkCase &benchmark : cases)
+			if (name == benchmark.name)
+				found = &benchmark;
+		if (!found)
+		{
+			std::fprintf(stderr, "unknown case %s, the cases are:", name.c_str());
+			for (const benchmarkCase &benchmark : cases)
+				std::fprintf(stderr, " %s%s", benchmark.name, benchmark.sizes.empty() ? "" : "[:n]");
+			std::fprintf(stderr, "\n");
+			return 1;
+		}
+		if (colon != std::string::npos)
+			selected.push_back({found, {unsigned(std::atoi(argument.c_str() + colon + 1))}});
+		else
+			selected.push_back({found, found->sizes});
+	}
+	if (selected.empty())
+		for (const benchmarkCase &benchmark : cases)
+			selected.push_back({&benchmark, benchmark.sizes});
+
+	// forked children inherit the options of this thread
+	checkOptions::scope checking(checks);
+	std::printf("%-20s %-6s %12s %12s %12s %12s\n", "case", "result", "wall [s]", "peak RSS [kB]", "nodes", "largest poly");
+	for (const auto &[benchmark, sizes] : selected)
+	{
+		if (sizes.empty())
+			report(*benchmark, 0, repeat, detailed);
+		for (unsigned n : sizes)
+			report(*benchmark, n, repeat, detailed);
+	}
+	return 0;
+}
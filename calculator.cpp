@@ -1,10 +1,75 @@
 #include "calculator.h"
+#include "gcd.h"
+#include "hashcons.h"
+#include "modular.h"
+#include "parallel.h"
+#include "rational.h"
+#include "resultcache.h"
+#include "serializer.h"
 
 using namespace calc;
 
+namespace
+{
+    // where conjugation sends the exponents of every slot, each slot is looked up in the symbol table once
+    class conjugation
+    {
+    public:
+        // conj of the powers of a monomial, unit terms keep their slot with the exponent negated
+        exponentVector map(const exponentVector &product)
+        {
+            exponentVector result;
+            product.forEach([&](unsigned slot, int power)
+                            {
+                                const image &target = imageOf(slot);
+                                result = result * exponentVector(target.slot, target.inverse ? -power : power); });
+            return result;
+        }
+
+    private:
+        struct image
+        {
+            unsigned slot = 0;
+            bool inverse = false;
+            bool known = false;
+        };
+
+        const image &imageOf(unsigned slot)
+        {
+            if (slot >= images.size())
+                images.resize(slot + 1);
+            image &found = images[slot];
+            if (!found.known)
+            {
+                const symbolId id = symbols().symbolAt(slot);
+                if (isReal(id) || isUnit(id))
+                    found.slot = slot;
+                else
+                    found.slot = slotOf(isQuasi(id) ? symbols().conjugate(id) : id ^ symbolBits::conjugationMark);
+                found.inverse = isUnit(id);
+                found.known = true;
+            }
+            return found;
+        }
+
+        std::vector<image> images;
+    };
+}
+
 operationNode *operationNode::conj() const
 {
-    return new operationNode(left->conj(), right->conj(), operation);
+    nodeCache *cache = nodeCache::current();
+    if (cache)
+        if (expressionNode *known = cache->conjugate(this))
+            return static_cast<operationNode *>(known);
+    operationNode *result = makeNode<operationNode>(left->conj(), right->conj(), operation);
+    if (cache)
+    {
+        // conjugation is an involution, the way back is known as well
+        cache->rememberConjugate(this, result);
+        cache->rememberConjugate(result, const_cast<operationNode *>(this));
+    }
+    return result;
 }
 
 expressionNode *operationNode::add(expressionNode *second) const
@@ -17,7 +82,7 @@ expressionNode *operationNode::add(polyNode *secondPoly) const
     if (secondPoly->checkZeroEquality())
         return const_cast<operationNode *>(this);
     if (operation != operationType::ADDITION)
-        return new operationNode(secondPoly, const_cast<operationNode *>(this), operationType::ADDITION);
+        return makeNode<operationNode>(secondPoly, const_cast<operationNode *>(this), operationType::ADDITION);
     return (secondPoly->add(left))->add(right);
 }
 
@@ -29,13 +94,13 @@ expressionNode *operationNode::add(operationNode *secondOp) const
         {
             return (add(secondOp->left))->add(secondOp->right);
         }
-        return new operationNode(const_cast<operationNode *>(this), secondOp, operationType::ADDITION);
+        return makeNode<operationNode>(const_cast<operationNode *>(this), secondOp, operationType::ADDITION);
     }
     if (secondOp->operation == operationType::ADDITION)
     {
-        return new operationNode(secondOp, const_cast<operationNode *>(this), operationType::ADDITION);
+        return makeNode<operationNode>(secondOp, const_cast<operationNode *>(this), operationType::ADDITION);
     }
-    return new operationNode(const_cast<operationNode *>(this), secondOp, operationType::ADDITION);
+    return makeNode<operationNode>(const_cast<operationNode *>(this), secondOp, operationType::ADDITION);
 }
 
 expressionNode *operationNode::multiply(constTy coef) const
@@ -51,12 +116,12 @@ expressionNode *operationNode::multiply(constTy coef) const
 expressionNode *operationNode::multiply(polyNode *secondPoly) const
 {
     if (secondPoly->checkZeroEquality())
-        return new polyNode();
+        return makeNode<polyNode>();
     if (operation == operationType::MULTIPLICATION)
         return (secondPoly->multiply(left))->multiply(right);
     if (operation == operationType::DIVISION)
         return (secondPoly->multiply(left))->divide(right);
-    return new operationNode(secondPoly, const_cast<operationNode *>(this), operationType::MULTIPLICATION);
+    return makeNode<operationNode>(secondPoly, const_cast<operationNode *>(this), operationType::MULTIPLICATION);
 }
 
 expressionNode *operationNode::multiply(operationNode *secondOp) const
@@ -83,13 +148,13 @@ expressionNode *operationNode::multiply(operationNode *secondOp) const
         {
             return (multiply(secondOp->left))->multiply(secondOp->right);
         }
-        return new operationNode(const_cast<operationNode *>(this), secondOp, operationType::MULTIPLICATION);
+        return makeNode<operationNode>(const_cast<operationNode *>(this), secondOp, operationType::MULTIPLICATION);
     }
     if (secondOp->operation == operationType::MULTIPLICATION)
     {
-        return new operationNode(secondOp, const_cast<operationNode *>(this), operationType::MULTIPLICATION);
+        return makeNode<operationNode>(secondOp, const_cast<operationNode *>(this), operationType::MULTIPLICATION);
     }
-    return new operationNode(const_cast<operationNode *>(this), secondOp, operationType::MULTIPLICATION);
+    return makeNode<operationNode>(const_cast<operationNode *>(this), secondOp, operationType::MULTIPLICATION);
 }
 
 expressionNode *operationNode::divide(polyNode *secondPoly, const bool isDivident) const
@@ -101,12 +166,12 @@ expressionNode *operationNode::divide(polyNode *secondPoly, const bool isDividen
             expressionNode *denominator = right->multiply(secondPoly);
             return left->divide(denominator);
         }
-        return new operationNode(const_cast<operationNode *>(this), secondPoly, operationType::DIVISION);
+        return makeNode<operationNode>(const_cast<operationNode *>(this), secondPoly, operationType::DIVISION);
     }
     else
     {
         if (secondPoly->checkZeroEquality())
-            return new polyNode();
+            return makeNode<polyNode>();
         if (operation == operationType::DIVISION)
         {
             expressionNode *nominator = secondPoly->multiply(right);
@@ -114,7 +179,7 @@ expressionNode *operationNode::divide(polyNode *secondPoly, const bool isDividen
         }
         else
         {
-            return new operationNode(secondPoly, const_cast<operationNode *>(this), operationType::DIVISION);
+            return makeNode<operationNode>(secondPoly, const_cast<operationNode *>(this), operationType::DIVISION);
         }
     }
 }
@@ -139,7 +204,7 @@ expressionNode *operationNode::divide(operationNode *secondOp, const bool isDivi
             expressionNode *nominator = multiply(secondOp->right);
             return nominator->divide(secondOp->left);
         }
-        return new operationNode(const_cast<operationNode *>(this), secondOp, operationType::DIVISION);
+        return makeNode<operationNode>(const_cast<operationNode *>(this), secondOp, operationType::DIVISION);
     }
     else
     {
@@ -147,235 +212,535 @@ expressionNode *operationNode::divide(operationNode *secondOp, const bool isDivi
     }
 }
 
-expressionNode *operationNode::expandAddition(polyNode *secondPoly) const
+expressionNode *operationNode::expand()
 {
-    if (operation != operationType::DIVISION)
-        return add(secondPoly);
-    return (left->add(right->multiply(secondPoly)))->divide(right);
+    metricTimer timer(metricKind::EXPAND);
+    // the tree itself is left untouched, so several expansions may walk it at once
+    nodeCache *cache = nodeCache::current();
+    if (cache)
+        if (expressionNode *known = cache->expansion(this))
+            return known;
+    // an expansion of an earlier run is decoded rather than computed again
+    resultCache *disk = resultCache::current();
+    canonicalKey key;
+    expressionNode *result = nullptr;
+    if (disk)
+    {
+        key = canonicalHash(this);
+        result = disk->find(key);
+    }
+    if (!result)
+    {
+        const rationalFunction expanded = rationalFunction::of(this);
+        timer.produced(expanded.numerator().size() + (expanded.isPolynomial() ? 0 : expanded.denominator().size()));
+        result = expanded.toExpression();
+        if (disk)
+            disk->store(key, result);
+    }
+    if (cache)
+    {
+        cache->rememberExpansion(this, result);
+        cache->rememberExpansion(result, result);
+    }
+    return result;
 }
 
-expressionNode *operationNode::expandAddition(operationNode *secondOp) const
+const bool operationNode::checkZeroEquality() const
 {
-    if (operation != operationType::DIVISION)
-    {
-        if (secondOp->operation != operationType::DIVISION)
-            return add(secondOp);
-        return secondOp->expandAddition(const_cast<operationNode *>(this));
-    }
-    if (secondOp->operation != operationType::DIVISION)
-        return (left->add(right->multiply(secondOp)))->divide(right);
-    expressionNode *nominator = (left->multiply(secondOp->right))->add(right->multiply(secondOp->left));
-    return nominator->divide(right->multiply(secondOp->right));
+    // an expanded expression is a reduced fraction, it vanishes with its numerator
+    if (operation == operationType::DIVISION && dynamic_cast<polyNode *>(left) && dynamic_cast<polyNode *>(right))
+        return left->checkZeroEquality();
+    return rationalFunction::of(this).checkZeroEquality();
 }
 
-expressionNode *operationNode::expandMultiplication(polyNode *secondPoly) const
+const bool operationNode::requiresBracketsPrinting() const
 {
-    if (operation != operationType::ADDITION)
+    return !(operation == operationType::MULTIPLICATION);
+}
+
+symbolTable &symbolTable::global()
+{
+    static symbolTable table;
+    return table;
+}
+
+symbolId symbolTable::add(std::unique_ptr<term> value, symbolId flags)
+{
+    if ((flags & symbolBits::quasi) && !freeQuasiSlots.empty())
     {
-        return multiply(secondPoly);
+        const unsigned slot = freeQuasiSlots.back();
+        freeQuasiSlots.pop_back();
+        value->id = (symbolId(slot) << symbolBits::indexShift) | flags;
+        slots[slot] = std::move(value);
+        return slots[slot]->id;
     }
-    return (left->multiply(secondPoly))->add(right->multiply(secondPoly));
+    symbolId id = (symbolId(slots.size()) << symbolBits::indexShift) | flags;
+    value->id = id;
+    slots.push_back(std::move(value));
+    // the conjugate of plain and quasi terms is a separate variable in the slot right after
+    if (!(flags & (symbolBits::real | symbolBits::unit)))
+        slots.emplace_back();
+    return id;
 }
 
-expressionNode *operationNode::expandMultiplication(operationNode *secondOp) const
+symbolId symbolTable::intern(const std::string &name, basicTerm::termProperties props)
 {
-    if (operation != operationType::ADDITION)
+    const symbolId flags = (props.isReal ? symbolBits::real : 0) | (props.isUnit ? symbolBits::unit : 0);
     {
-        return multiply(secondOp);
+        std::shared_lock lock(guard);
+        auto it = basicIndex.find({name, flags});
+        if (it != basicIndex.end())
+            return it->second;
     }
-    return (left->multiply(secondOp))->add(right->multiply(secondOp));
+    std::unique_lock lock(guard);
+    auto it = basicIndex.find({name, flags});
+    if (it != basicIndex.end())
+        return it->second;
+    symbolId id = add(std::make_unique<basicTerm>(name, props), flags);
+    if (!props.isReal && !props.isUnit)
+    {
+        // plain terms have a distinct conjugate, it is printed with a "$" mark
+        auto conjugated = std::make_unique<basicTerm>(name, props);
+        conjugated->id = id | symbolBits::conjugationMark;
+        slots.back() = std::move(conjugated);
+    }
+    basicIndex.insert({{name, flags}, id});
+    return id;
 }
 
-expressionNode *operationNode::expand()
+symbolId symbolTable::intern(const std::string &name, expressionNode *hiddenExpression)
 {
-    left = left->expand();
-    right = right->expand();
-    if (operation == operationType::ADDITION)
+    std::unique_lock lock(guard);
+    auto it = quasiIndex.find({name, hiddenExpression});
+    if (it != quasiIndex.end())
+        return it->second;
+    symbolId id = add(std::make_unique<quasiTerm>(name, hiddenExpression), symbolBits::quasi);
+    quasiIndex.insert({{name, hiddenExpression}, id});
+    if (arena *owner = arena::current())
     {
-        return left->expandAddition(right);
+        std::vector<symbolId> &owned = quasiOwners[owner];
+        if (owned.empty())
+            owner->subscribe(*this);
+        owned.push_back(id);
     }
-    if (operation == operationType::MULTIPLICATION)
+    return id;
+}
+
+void symbolTable::released(arena &owner)
+{
+    std::unique_lock lock(guard);
+    auto owned = quasiOwners.find(&owner);
+    if (owned == quasiOwners.end())
+        return;
+    for (symbolId id : owned->second)
     {
-        return left->expandMultiplication(right);
+        const unsigned slot = slotOf(id);
+        const quasiTerm *retired = static_cast<const quasiTerm *>(slots[slot].get());
+        quasiIndex.erase({retired->name, retired->hidden()});
+        slots[slot].reset();
+        slots[slot + 1].reset();
+        freeQuasiSlots.push_back(slot);
     }
-    if (operation == operationType::DIVISION)
+    quasiOwners.erase(owned);
+    owner.unsubscribe(*this);
+}
+
+symbolId symbolTable::conjugate(symbolId id)
+{
+    const symbolId partner = id ^ symbolBits::conjugationMark;
     {
-        return left->divide(right);
+        std::shared_lock lock(guard);
+        if (slots[slotOf(partner)])
+            return partner;
     }
+    // conjugating the hidden expression may intern other terms, so it runs unlocked
+    std::unique_ptr<term> conjugated = std::make_unique<quasiTerm>(name(id), static_cast<quasiTerm *>(lookup(id))->hiddenConj());
+    conjugated->id = partner;
+    std::unique_lock lock(guard);
+    std::unique_ptr<term> &slot = slots[slotOf(partner)];
+    if (!slot)
+        slot = std::move(conjugated);
+    return partner;
 }
 
-const bool operationNode::requiresBracketsPrinting() const
+term *symbolTable::lookup(symbolId id) const
 {
-    return !(operation == operationType::MULTIPLICATION);
+    std::shared_lock lock(guard);
+    return occupied(slotOf(id));
+}
+
+symbolId symbolTable::symbolAt(unsigned slot) const
+{
+    std::shared_lock lock(guard);
+    return occupied(slot)->id;
 }
 
-const bool term::operator<(const term &other) const
+term *symbolTable::occupied(unsigned slot) const
 {
-    if (name != other.name)
-        return name < other.name;
-    if (hasConjugationMark != other.hasConjugationMark)
-        return !hasConjugationMark;
-    return false;
+    // a stale exponent vector may still name a retired quasi term
+    if (slot >= slots.size() || !slots[slot])
+        throw std::logic_error("symbolTable: no term in slot " + std::to_string(slot));
+    return slots[slot].get();
 }
 
-const bool term::operator==(const term &other) const
+expressionNode *calc::conjugateSymbol(symbolId id)
 {
-    return (name == other.name) && (hasConjugationMark == other.hasConjugationMark);
+    if (isQuasi(id))
+        return makeNode<polyNode>(monomial(1, symbols().conjugate(id)));
+    if (isReal(id))
+        return makeNode<polyNode>(monomial(1, id));
+    if (isUnit(id))
+        return makeNode<polyNode>(monomial(1, exponentVector(slotOf(id), -1)));
+    return makeNode<polyNode>(monomial(1, id ^ symbolBits::conjugationMark));
 }
 
 expressionNode *basicTerm::conj() const
 {
-    if (props.isReal)
-        return new polyNode(monomial(1, new basicTerm(*this)));
-    if (props.isUnit)
-        return make_scalar(1)->divide(new polyNode(monomial(1, new basicTerm(*this))));
-    basicTerm *conjugated = new basicTerm(*this);
-    conjugated->invertMark();
-    return new polyNode(monomial(1, conjugated));
+    return conjugateSymbol(id);
 }
 
 expressionNode *quasiTerm::conj() const
 {
-    return new polyNode(monomial(1, new quasiTerm(name, hiddenExpression->conj())));
+    return conjugateSymbol(id);
 }
 
 expressionNode *monomial::conj() const
 {
-    expressionNode *result = make_scalar(std::conj(coef));
-    for (auto const &[name, degree] : product)
-    {
-        expressionNode *conj_term = degree.first->conj();
-        for (int i = 0; i < degree.second; ++i)
-            result = result->multiply(conj_term);
-    }
-    return result;
+    return makeNode<polyNode>(*this)->conj();
 }
 
 const bool monomial::operator<(const monomial &other) const
 {
-    auto jt = other.product.begin();
-    for (auto it = product.begin(); it != product.end(); ++it)
-    {
-        if (jt == other.product.end())
-            return false;
-        if (it->first != jt->first)
-            return it->first < jt->first;
-        if (it->second.second < jt->second.second)
-            return (it == std::prev(product.end()));
-        if (jt->second.second < it->second.second)
-            return (jt != std::prev(other.product.end()));
-        ++jt;
-    }
-    if (jt != other.product.end())
-        return true;
-    return false;
+    return product < other.product;
 }
 
 const bool monomial::operator==(const monomial &other) const
 {
-    return std::equal(product.begin(), product.end(), other.product.begin(), other.product.end(),
-                      [](const auto &a, const auto &b)
-                      { return std::make_pair(a.first, a.second.second) == std::make_pair(b.first, b.second.second); });
+    return product == other.product;
 }
 
 monomial monomial::operator*(const monomial &other) const
 {
-    monomial result = *this;
-    result.coef = this->coef * other.coef;
-    for (const auto &[name, degree] : other.product)
-    {
-        auto it = result.product.find(name);
-        if (it != result.product.end())
-            it->second.second += degree.second;
-        else
-            result.product.insert({name, {degree.first, degree.second}});
-    }
-    return result;
+    return monomial(coefRing().mul(coef, other.coef), product * other.product);
 }
 
-void monomial::operator*=(const constTy k) const
+void monomial::operator*=(const constTy k)
 {
-    resetCoef(coef * k);
+    coef *= k;
 }
 
 const bool monomial::dividedBy(const monomial &divider) const
 {
-    for (auto const &[name, degree] : divider.product)
-    {
-        auto it = product.find(name);
-        if (it == product.end() || it->second.second < degree.second)
-            return false;
-    }
-    return true;
+    return product.dividedBy(divider.product);
 }
 
 monomial monomial::divide(const monomial &divider) const
 {
-    if (divider.product.empty())
-        return *this;
-    monomial result = *this;
-    for (auto const &[name, degree] : divider.product)
+    return monomial(coef, product / divider.product);
+}
+
+expressionNode *polyNode::conj() const
+{
+    metricTimer timer(metricKind::CONJ);
+    nodeCache *cache = nodeCache::current();
+    if (cache)
+        if (expressionNode *known = cache->conjugate(this))
+            return known;
+    // one pass over the monomials, exponents are moved to the conjugate slots as they are
+    // conj(u) = u^-1 for unit terms, so the conjugate stays a (Laurent) polynomial
+    conjugation images;
+    std::vector<monomial> terms(size());
+    for (size_t i = 0; i < size(); ++i)
+        terms[i] = monomial(std::conj(coefAt(i)), images.map(powers[i]));
+    polyNode *result = makeNode<polyNode>(collect(std::move(terms)));
+    timer.produced(result->size());
+    if (cache)
     {
-        auto it = result.product.find(name);
-        it->second.second -= degree.second;
-        if (it->second.second == 0)
-            result.product.erase(it);
+        cache->rememberConjugate(this, result);
+        cache->rememberConjugate(result, const_cast<polyNode *>(this));
     }
     return result;
 }
 
-expressionNode *polyNode::conj() const
+void polyNode::reserve(size_t count)
 {
-    expressionNode *result = new polyNode();
-    for (monomial mono : sum)
-        result = result->add(mono.conj());
-    return result;
+    powers.reserve(count);
+    re.reserve(count);
+    im.reserve(count);
 }
 
 void polyNode::operator+=(const monomial &mono)
 {
-    auto it = sum.find(mono);
-    if (it != sum.end())
+    const coefRing ring;
+    auto it = std::lower_bound(powers.begin(), powers.end(), mono.product);
+    const size_t index = it - powers.begin();
+    if (it != powers.end() && *it == mono.product)
+    {
+        const constTy coef = ring.add(coefAt(index), mono.coef);
+        re[index] = coef.real();
+        im[index] = coef.imag();
+        if (coef == 0)
+        {
+            countCancelled(metricKind::ADD, 2);
+            powers.erase(it);
+            re.erase(re.begin() + index);
+            im.erase(im.begin() + index);
+        }
+    }
+    else if (!ring.isZero(mono.coef))
+    {
+        powers.insert(it, mono.product);
+        re.insert(re.begin() + index, mono.coef.real());
+        im.insert(im.begin() + index, mono.coef.imag());
+    }
+}
+
+void polyNode::merge(const polyNode &first, size_t i, size_t iEnd, const polyNode &second, size_t j, size_t jEnd)
+{
+    // linear merge of two sorted ranges, like terms are combined on the way
+    const coefRing ring;
+    size_t cancelled = 0;
+    reserve(size() + (iEnd - i) + (jEnd - j));
+    while (i < iEnd && j < jEnd)
     {
-        if (it->coef + mono.coef != 0)
-            it->resetCoef(it->coef + mono.coef);
+        const int order = first.powers[i].compare(second.powers[j]);
+        if (order < 0)
+        {
+            push(first.powers[i], first.coefAt(i));
+            ++i;
+        }
+        else if (order > 0)
+        {
+            push(second.powers[j], second.coefAt(j));
+            ++j;
+        }
         else
-            sum.erase(it);
+        {
+            const constTy coef = ring.add(first.coefAt(i), second.coefAt(j));
+            if (coef != 0)
+                push(first.powers[i], coef);
+            else
+                cancelled += 2;
+            ++i;
+            ++j;
+        }
     }
-    else
-        sum.insert(mono);
-    return;
+    for (; i < iEnd; ++i)
+        push(first.powers[i], first.coefAt(i));
+    for (; j < jEnd; ++j)
+        push(second.powers[j], second.coefAt(j));
+    countCancelled(metricKind::ADD, cancelled);
 }
 
 polyNode polyNode::operator+(const polyNode &other) const
 {
-    polyNode result = *this;
-    for (const auto &mono : other.sum)
-        result += (mono);
+    metricTimer timer(metricKind::ADD);
+    polyNode result;
+    const size_t parts = std::min<size_t>(threadCount(), (size() + other.size()) / (parallelSumThreshold / 2));
+    if (parts < 2 || size() < parts)
+    {
+        result.merge(*this, 0, size(), other, 0, other.size());
+        timer.produced(result.size());
+        return result;
+    }
+    // both operands are cut at the same monomials, each slice is merged on its own thread
+    // and the slices are concatenated in order
+    std::vector<size_t> cutsMine(parts + 1), cutsOther(parts + 1);
+    cutsMine[parts] = size();
+    cutsOther[parts] = other.size();
+    for (size_t part = 1; part < parts; ++part)
+    {
+        cutsMine[part] = size() * part / parts;
+        cutsOther[part] = std::lower_bound(other.powers.begin(), other.powers.end(), powers[cutsMine[part]]) - other.powers.begin();
+    }
+    // slices are built by the thread merging them, so each one allocates from that thread's memory
+    std::vector<polyNode> slices(parts);
+    parallelFor(parts, [&](size_t part)
+                {
+                    polyNode slice;
+                    slice.merge(*this, cutsMine[part], cutsMine[part + 1], other, cutsOther[part], cutsOther[part + 1]);
+                    slices[part] = std::move(slice); });
+    size_t total = 0;
+    for (const auto &slice : slices)
+        total += slice.size();
+    result.reserve(total);
+    for (const auto &slice : slices)
+    {
+        result.powers.insert(result.powers.end(), slice.powers.begin(), slice.powers.end());
+        result.re.insert(result.re.end(), slice.re.begin(), slice.re.end());
+        result.im.insert(result.im.end(), slice.im.begin(), slice.im.end());
+    }
+    timer.produced(result.size());
     return result;
 }
 
 polyNode polyNode::operator*(const monomial &other) const
 {
+    // the monomial order is preserved by multiplication, so the result needs no sorting
+    const coefRing ring;
     polyNode result;
-    for (const auto &mono : sum)
-        result += mono * other;
+    if (ring.isZero(other.coef))
+        return result;
+    result.reserve(size());
+    for (size_t i = 0; i < size(); ++i)
+        result.push(powers[i] * other.product, ring.mul(coefAt(i), other.coef));
     return result;
 }
 
-polyNode polyNode::operator*(const polyNode &other) const
+polyNode polyNode::multiplyRows(const polyNode &f, size_t first, size_t last, const polyNode &g)
 {
+    // Johnson's algorithm: a heap holds at most one pending product f_i * g_j per monomial of f,
+    // products leave the heap in increasing order, so like terms are merged as they are produced
+    // f_{i+1} g_0 enters only once f_i g_0 is consumed, which keeps the heap as small as the order allows
+    const coefRing ring;
     polyNode result;
-    for (const auto &mono : other.sum)
-        result = result + (*this * mono);
+    struct pending
+    {
+        exponentVector product;
+        size_t i, j;
+    };
+    comparisonCount compared;
+    auto later = [&compared](const pending &a, const pending &b)
+    {
+        compared.tick();
+        return b.product < a.product;
+    };
+    size_t cancelled = 0;
+    arenaVector<pending> heap;
+    heap.reserve(last - first);
+    heap.push_back({f.powers[first] * g.powers[0], first, 0});
+
+    result.reserve((last - first) + g.size());
+    while (!heap.empty())
+    {
+        exponentVector product = heap.front().product;
+        constTy coef = 0;
+        size_t merged = 0;
+        do
+        {
+            ++merged;
+            std::pop_heap(heap.begin(), heap.end(), later);
+            const size_t i = heap.back().i, j = heap.back().j;
+            coef = ring.add(coef, ring.mul(f.coefAt(i), g.coefAt(j)));
+            if (j + 1 < g.size())
+            {
+                heap.back().product = f.powers[i] * g.powers[j + 1];
+                heap.back().j = j + 1;
+                std::push_heap(heap.begin(), heap.end(), later);
+            }
+            else
+                heap.pop_back();
+            if (j == 0 && i + 1 < last)
+            {
+                heap.push_back({f.powers[i + 1] * g.powers[0], i + 1, 0});
+                std::push_heap(heap.begin(), heap.end(), later);
+            }
+        } while (!heap.empty() && heap.front().product == product);
+        if (coef != 0)
+            result.push(product, coef);
+        else if (merged > 1)
+            cancelled += merged;
+    }
+    countCancelled(metricKind::MULTIPLY, cancelled);
     return result;
 }
 
+polyNode polyNode::operator*(const polyNode &other) const
+{
+    const polyNode &f = size() <= other.size() ? *this : other;
+    const polyNode &g = size() <= other.size() ? other : *this;
+    metricTimer timer(metricKind::MULTIPLY);
+    if (f.checkZeroEquality())
+        return polyNode();
+    if (f.size() == 1)
+    {
+        polyNode result = g * f.at(0);
+        timer.produced(result.size());
+        return result;
+    }
+    const size_t parts = std::min<size_t>({threadCount(), f.size(), f.size() * g.size() / parallelProductThreshold});
+    if (parts < 2)
+    {
+        polyNode result = multiplyRows(f, 0, f.size(), g);
+        timer.produced(result.size());
+        return result;
+    }
+
+    // the shorter factor is split into row blocks multiplied on separate threads,
+    // partial products are then summed pairwise, always combining neighbours, so the result does not depend on timing
+    // every partial stays alive until the end, so memory is only released by the calling thread
+    std::vector<std::vector<polyNode>> rounds(1, std::vector<polyNode>(parts));
+    parallelFor(parts, [&](size_t part)
+                { rounds[0][part] = multiplyRows(f, f.size() * part / parts, f.size() * (part + 1) / parts, g); });
+    while (rounds.back().size() > 1)
+    {
+        const std::vector<polyNode> &previous = rounds.back();
+        std::vector<polyNode> next((previous.size() + 1) / 2);
+        parallelFor(next.size(), [&](size_t pair)
+                    {
+                        if (2 * pair + 1 < previous.size())
+                            next[pair] = previous[2 * pair] + previous[2 * pair + 1];
+                        else
+                            next[pair] = polyNode(previous[2 * pair]); });
+        rounds.push_back(std::move(next));
+    }
+    timer.produced(rounds.back()[0].size());
+    return rounds.back()[0];
+}
+
 polyNode polyNode::operator*(const constTy k) const
 {
+    const coefRing ring;
+    if (ring.isZero(k))
+        return polyNode();
     polyNode result(*this);
-    for (auto &mono : result.sum)
-        mono *= k;
+    int *r = result.re.data(), *m = result.im.data();
+    if (ring.p)
+    {
+        for (size_t i = 0; i < size(); ++i)
+        {
+            const constTy coef = mulMod(constTy(r[i], m[i]), k, ring.p);
+            r[i] = coef.real();
+            m[i] = coef.imag();
+        }
+        return result;
+    }
+    const int kr = k.real(), ki = k.imag();
+    for (size_t i = 0; i < size(); ++i)
+    {
+        const int x = r[i], y = m[i];
+        r[i] = x * kr - y * ki;
+        m[i] = x * ki + y * kr;
+    }
+    return result;
+}
+
+polyNode polyNode::collect(std::vector<monomial> terms)
+{
+    metricTimer timer(metricKind::COLLECT);
+    const coefRing ring;
+    comparisonCount compared;
+    std::sort(terms.begin(), terms.end(), [&compared](const monomial &a, const monomial &b)
+              {
+                  compared.tick();
+                  return a < b; });
+    polyNode result;
+    result.reserve(terms.size());
+    size_t cancelled = 0;
+    for (size_t i = 0; i < terms.size();)
+    {
+        constTy coef = 0;
+        size_t j = i;
+        for (; j < terms.size() && terms[j].product == terms[i].product; ++j)
+            coef = ring.add(coef, terms[j].coef);
+        if (!ring.isZero(coef))
+            result.push(terms[i].product, coef);
+        else if (j - i > 1)
+            cancelled += j - i;
+        i = j;
+    }
+    countCancelled(metricKind::COLLECT, cancelled);
+    timer.produced(result.size());
     return result;
 }
 
@@ -388,25 +753,35 @@ expressionNode *polyNode::divide(polyNode *secondPoly, const bool isDivident) co
 {
     if (isDivident)
     {
-        if (sum.empty())
-            return new polyNode();
-        if (secondPoly->sum.size() == 1)
+        if (checkZeroEquality())
+            return makeNode<polyNode>();
+        if (size() > 1 && secondPoly->size() > 1)
+        {
+            // common factors are cancelled first, what remains is coprime
+            const polyNode common = gcd(*this, *secondPoly);
+            const bool trivial = common.size() == 1 && common.powersAt(0).empty() && common.coefAt(0) == constTy(1);
+            polyNode nominator, denominator;
+            if (!trivial && divideExact(*this, common, nominator) && divideExact(*secondPoly, common, denominator))
+                return (makeNode<polyNode>(nominator))->divide(makeNode<polyNode>(denominator));
+        }
+        if (secondPoly->size() == 1)
         {
-            monomial divider = *secondPoly->sum.begin();
-            if (!divider.product.empty() && dividedBy(divider))
+            // monomials are invertible, negative exponents keep the quotient a polynomial
+            monomial divider = secondPoly->at(0);
+            if (!divider.product.empty())
                 return divide(divider);
-            if (divider.product.empty() && (divider.coef == 1))
+            if (divider.product.empty() && coefRing().equal(divider.coef, 1))
                 return const_cast<polyNode *>(this);
-            if (divider.product.empty() && (divider.coef == -1))
+            if (divider.product.empty() && coefRing().equal(divider.coef, -1))
                 return negate();
         }
-        if (sum.size() == 1)
+        if (size() == 1)
         {
-            monomial divider = *sum.begin();
-            if (divider.product.size() && secondPoly->dividedBy(divider))
+            monomial divider = at(0);
+            if (!divider.product.empty() && secondPoly->dividedBy(divider))
                 return make_scalar(1)->divide(secondPoly->divide(divider));
         }
-        return new operationNode(const_cast<polyNode *>(this), secondPoly, operationNode::operationType::DIVISION);
+        return makeNode<operationNode>(const_cast<polyNode *>(this), secondPoly, operationNode::operationType::DIVISION);
     }
     else
         return secondPoly->divide(const_cast<polyNode *>(this));
@@ -419,9 +794,9 @@ expressionNode *polyNode::divide(operationNode *secondOp, const bool isDivident)
 
 const bool polyNode::dividedBy(const monomial &divider) const
 {
-    for (auto mono : sum)
+    for (const auto &product : powers)
     {
-        if (!mono.dividedBy(divider))
+        if (!product.dividedBy(divider.product))
             return false;
     }
     return true;
@@ -429,12 +804,15 @@ const bool polyNode::dividedBy(const monomial &divider) const
 
 expressionNode *polyNode::divide(const monomial &divider) const
 {
-    expressionNode *result = new polyNode();
-    for (auto mono : sum)
-        result = result->add(new polyNode(mono.divide(divider)));
-    if (divider.coef != 1 && divider.coef != -1)
+    // the order of monomials is preserved by division, only the powers change
+    polyNode quotient(*this);
+    for (auto &product : quotient.powers)
+        product = product / divider.product;
+    polyNode *result = makeNode<polyNode>(std::move(quotient));
+    const coefRing ring;
+    if (!ring.equal(divider.coef, 1) && !ring.equal(divider.coef, -1))
         return result->divide(make_scalar(divider.coef));
-    else if (divider.coef == -1)
+    else if (ring.equal(divider.coef, -1))
         return result->negate();
     else
         return result;
@@ -442,174 +820,27 @@ expressionNode *polyNode::divide(const monomial &divider) const
 
 polyNode *calc::make_term(std::string name)
 {
-    return new polyNode(monomial(1, new basicTerm(name)));
+    return makeNode<polyNode>(monomial(1, symbols().intern(name, {false, false})));
 }
 
 polyNode *calc::make_unit_term(std::string name)
 {
-    return new polyNode(monomial(1, new basicTerm(name, {false, true})));
+    return makeNode<polyNode>(monomial(1, symbols().intern(name, {false, true})));
 }
 
 polyNode *calc::make_real_term(std::string name)
 {
-    return new polyNode(monomial(1, new basicTerm(name, {true, false})));
+    return makeNode<polyNode>(monomial(1, symbols().intern(name, {true, false})));
 }
 
 polyNode *calc::make_scalar(constTy scalar)
 {
     if (scalar == 0)
-        return new polyNode();
-    return new polyNode(monomial(scalar, std::map<std::string, std::pair<term *, int>>()));
+        return makeNode<polyNode>();
+    return makeNode<polyNode>(monomial(scalar, exponentVector()));
 }
 
-void operationNode::print() const
+void expressionNode::print(std::ostream &out) const
 {
-    std::string opChar;
-    switch (operation)
-    {
-    case (operationType::ADDITION):
-        opChar = " + ";
-        break;
-    case (operationType::MULTIPLICATION):
-        opChar = "";
-        break;
-    case (operationType::DIVISION):
-        opChar = " / ";
-        break;
-    }
-    const bool printLeftBrackets = left->requiresBracketsPrinting();
-    if (opChar != " + " && printLeftBrackets)
-        std::cout << "(";
-    left->print();
-    if (opChar != " + " && printLeftBrackets)
-        std::cout << ")";
-    std::cout << opChar;
-    const bool printRightBrackets = right->requiresBracketsPrinting();
-    if (opChar != " + " && printRightBrackets)
-        std::cout << "(";
-    right->print();
-    if (opChar != " + " && printRightBrackets)
-        std::cout << ")";
-}
-
-void polyNode::print() const
-{
-    if (sum.empty())
-    {
-        std::cout << 0;
-        return;
-    }
-    for (auto it = sum.begin(); it != sum.end(); ++it)
-    {
-        auto mono = *it;
-        constTy coef = mono.coef;
-        if (coef.imag() != 0)
-        {
-            std::cout << "(";
-            std::cout << coef.real();
-            std::cout << " + ";
-            std::cout << coef.imag();
-            std::cout << "i)";
-        }
-        else
-        {
-            if (coef.real() > 0)
-            {
-                if (it != sum.begin())
-                    std::cout << " + ";
-            }
-            else
-            {
-                if (it != sum.begin())
-                    std::cout << " ";
-                std::cout << "- ";
-            }
-            if ((mono.product.empty()) || (coef.real() != 1) && (coef.real() != -1))
-                std::cout << std::abs(coef.real());
-        }
-        for (auto [name, degree] : mono.product)
-            std::cout << name << (degree.second > 1 ? "^" + std::to_string(degree.second) : "");
-    }
-}
-
-expressionNode *parseString(const std::string &line, size_t l, size_t r)
-{
-    while (l < r && line[l] == ' ')
-        ++l;
-    while (r > l && line[r - 1] == ' ')
-        --r;
-    if (r <= l)
-        return make_scalar(1);
-    unsigned counter = 0;
-    size_t curr = l;
-    size_t m, d, s;
-    m = r;
-    d = r;
-    s = r;
-    while (curr != r)
-    {
-        if (line[curr] == '(')
-        {
-            ++counter;
-            ++curr;
-            continue;
-        }
-        if (line[curr] == ')')
-        {
-            --counter;
-            ++curr;
-            continue;
-        }
-        if (counter == 0)
-        {
-            if (line[curr] == '+')
-                return parseString(line, l, curr)->add(parseString(line, curr + 1, r));
-            if (line[curr] == '-')
-                s = curr;
-            if (line[curr] == '*')
-            {
-                m = curr++;
-                continue;
-            }
-            if (line[curr] == '/')
-            {
-                d = curr++;
-                continue;
-            }
-        }
-        ++curr;
-    }
-    if (s != r && s != l)
-        return parseString(line, l, s)->substract(parseString(line, s + 1, r));
-    if (m != r)
-        return parseString(line, l, m)->multiply(parseString(line, m + 1, r));
-    if (d != r)
-        return parseString(line, l, d)->divide(parseString(line, d + 1, r));
-    if (line[l] == '(')
-    {
-        counter = 1;
-        size_t closing = l + 1;
-        while (closing < r)
-        {
-            if (line[closing] == '(')
-                ++counter;
-            if (line[closing] == ')')
-                --counter;
-            if (counter == 0)
-                return parseString(line, l + 1, closing)->multiply(parseString(line, closing + 1, r));
-            ++closing;
-        }
-    }
-    if (l == r)
-        return make_scalar(1);
-    if (line[l] == '-')
-        return parseString(line, l + 1, r)->negate();
-    if (line[l] >= 48 && line[l] <= 57)
-    {
-        size_t numEnd = l + 1;
-        while (numEnd < r && (line[numEnd] >= 48) && (line[numEnd] <= 57))
-            ++numEnd;
-        return make_scalar(std::stoi(line.substr(l, numEnd - l)))->multiply(parseString(line, numEnd, r));
-    }
-    return make_unit_term(line.substr(l, 1))->multiply(parseString(line, l + 1, r));
+    serializer(out) << this;
 }
\ No newline at end of file
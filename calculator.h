@@ -4,26 +4,72 @@
 #include <string>
 #include <set>
 #include <map>
+#include <deque>
 #include <stack>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <complex>
 #include <algorithm>
+#include <utility>
+#include <stdexcept>
 
 // * debugging
 #include <iostream>
 
+// * memory
+#include "arena.h"
+#include "exponents.h"
+#include "metrics.h"
+
 namespace calc
 {
     using constTy = std::complex<int>;
 
+    class expressionNode;
     class operationNode;
     class polyNode;
 
+    // shares structurally equal nodes while a nodeCache is active (see hashcons.h)
+    expressionNode *internNode(expressionNode *node);
+
+    // nodes are created through here, so equal subexpressions of a query are built once
+    // a node must not change after it has been made
+    template <class Node, class... Args>
+    Node *makeNode(Args &&...args)
+    {
+        return static_cast<Node *>(internNode(new Node(std::forward<Args>(args)...)));
+    }
+
     // main abstract class describing rational complex-valued function
     // cannot be const to be able to modify expression tree
-    // always allocate dynamically
+    // always allocate dynamically, nodes live in the arena of the running query (see arena.h)
+    // callers never own nodes, whether a method returns this or a new node: the arena owns them all
+    // and reclaims them at once when it is released; nodes made outside of any arena live until exit
     class expressionNode
     {
     public:
+        static void *operator new(size_t size)
+        {
+            countNode();
+            return allocateNode(size);
+        }
+        static void operator delete(void *ptr) { deallocateNode(ptr); }
+        expressionNode() {}
+        // a copy is a new node, its hash is computed again
+        expressionNode(const expressionNode &) {}
+        expressionNode &operator=(const expressionNode &)
+        {
+            hashValue = 0;
+            return *this;
+        }
+        virtual ~expressionNode() {}
+
+        // cached hash of the structure, equal expressions have equal hashes
+        size_t structuralHash() const;
+        // structural equality, a pointer comparison for nodes shared by the same cache
+        const bool equals(const expressionNode *other) const;
+
         virtual expressionNode *conj() const = 0;
 
         // double dispatching of binary operations
@@ -46,21 +92,18 @@ namespace calc
         virtual expressionNode *divide(polyNode *secondPoly, const bool isDivident = true) const = 0;
         virtual expressionNode *divide(operationNode *secondOp, const bool isDivident = true) const = 0;
 
-        // double dispatching of bracket expansion
-        virtual expressionNode *expandAddition(expressionNode *second) const = 0;
-        virtual expressionNode *expandAddition(polyNode *secondPoly) const = 0;
-        virtual expressionNode *expandAddition(operationNode *secondOp) const = 0;
-        virtual expressionNode *expandMultiplication(expressionNode *second) const = 0;
-        virtual expressionNode *expandMultiplication(polyNode *secondPoly) const = 0;
-        virtual expressionNode *expandMultiplication(operationNode *secondOp) const = 0;
-
+        // brackets are expanded into a single fraction of polynomials (see rational.h)
         virtual expressionNode *expand() = 0;
 
         // printing data, utility predicates
         virtual const bool checkZeroEquality() const = 0; // TODO: add optional printing // TODO: make pure virtual
 
-        virtual void print() const = 0;
+        // plain text through a serializer, see serializer.h for other formats and for writing into memory
+        void print(std::ostream &out = std::cout) const;
         virtual const bool requiresBracketsPrinting() const = 0;
+
+    private:
+        mutable size_t hashValue = 0;
     };
 
     class operationNode : public expressionNode // a sum, product, or fraction of two expressions
@@ -106,40 +149,47 @@ namespace calc
         virtual expressionNode *divide(polyNode *secondPoly, const bool isDivident = true) const;
         virtual expressionNode *divide(operationNode *secondOp, const bool isDivident = true) const;
 
-        virtual expressionNode *expandAddition(expressionNode *second) const
-        {
-            return second->expandAddition(const_cast<operationNode *>(this));
-        }
-        virtual expressionNode *expandAddition(polyNode *secondPoly) const;
-        virtual expressionNode *expandAddition(operationNode *secondOp) const;
-
-        virtual expressionNode *expandMultiplication(expressionNode *second) const
-        {
-            return second->expandMultiplication(const_cast<operationNode *>(this));
-        }
-        virtual expressionNode *expandMultiplication(polyNode *secondPoly) const;
-        virtual expressionNode *expandMultiplication(operationNode *secondOp) const;
-
         virtual expressionNode *expand() override;
 
-        virtual const bool checkZeroEquality() const { return false; } // FIXME
+        virtual const bool checkZeroEquality() const;
+
+        operationType type() const { return operation; }
+        expressionNode *leftOperand() const { return left; }
+        expressionNode *rightOperand() const { return right; }
 
-        virtual void print() const override;
         virtual const bool requiresBracketsPrinting() const;
     };
 
+    // symbol ids carry the properties of a term in their low bits,
+    // the rest of the id is the first exponent slot of the term
+    // (plain and quasi terms take two consecutive slots, the second one for their conjugate)
+    using symbolId = uint32_t;
+
+    namespace symbolBits
+    {
+        constexpr symbolId conjugationMark = 1;
+        constexpr symbolId real = 2;
+        constexpr symbolId unit = 4;
+        constexpr symbolId quasi = 8;
+        constexpr unsigned indexShift = 4;
+    }
+
+    inline const bool isConjugated(symbolId id) { return id & symbolBits::conjugationMark; }
+    inline const bool isReal(symbolId id) { return id & symbolBits::real; }
+    inline const bool isUnit(symbolId id) { return id & symbolBits::unit; }
+    inline const bool isQuasi(symbolId id) { return id & symbolBits::quasi; }
+    inline unsigned slotOf(symbolId id) { return (id >> symbolBits::indexShift) + isConjugated(id); }
+
+    // interned once in the symbol table and shared by every monomial mentioning it
     class term
     {
     public:
-        term() {}
         term(const std::string _name)
             : name(_name) {}
+        virtual ~term() {}
 
-        bool hasConjugationMark = false;
-        void invertMark() { hasConjugationMark = !hasConjugationMark; }
-        std::string name;
-        const bool operator<(const term &other) const;
-        const bool operator==(const term &other) const;
+        const std::string name;
+        symbolId id = 0; // assigned by the symbol table
 
         virtual expressionNode *conj() const = 0;
     };
@@ -149,20 +199,16 @@ namespace calc
     public:
         expressionNode *conj() const;
 
-        basicTerm(const std::string _name)
-            : term(_name) {}
-
         struct termProperties
         {
             bool isReal;
             bool isUnit;
         };
 
-        basicTerm(const std::string _name, termProperties _props)
+        basicTerm(const std::string _name, termProperties _props = {false, false})
             : term(_name), props(_props) {}
 
-    private:
-        const termProperties props = {false, false};
+        const termProperties props;
     };
 
     class quasiTerm : public term
@@ -174,27 +220,61 @@ namespace calc
         {
         }
 
+        expressionNode *hidden() const { return hiddenExpression; }
+        expressionNode *hiddenConj() const { return hiddenExpression->conj(); }
+
     private:
         expressionNode *hiddenExpression;
     };
 
+    // process-wide table of terms
+    // interning happens once per term, afterwards monomials only deal with ids
+    // a quasi term belongs to the arena active when it is interned, like its hidden expression:
+    // it is retired when that arena releases its nodes, and its slots are given to later quasi terms
+    class symbolTable : private arena::listener
+    {
+    public:
+        static symbolTable &global();
+
+        symbolId intern(const std::string &name, basicTerm::termProperties props);
+        symbolId intern(const std::string &name, expressionNode *hiddenExpression);
+        symbolId conjugate(symbolId id); // conjugation partner of a quasi term, created on first use
+
+        // both throw std::logic_error for a slot without a term, such as one retired with its arena
+        term *lookup(symbolId id) const;
+        symbolId symbolAt(unsigned slot) const;
+        const std::string &name(symbolId id) const { return lookup(id)->name; }
+
+    private:
+        symbolId add(std::unique_ptr<term> value, symbolId flags);
+        term *occupied(unsigned slot) const; // with the guard held
+        void released(arena &owner) override;
+
+        mutable std::shared_mutex guard;
+        std::deque<std::unique_ptr<term>> slots;
+        std::map<std::pair<std::string, symbolId>, symbolId> basicIndex;
+        std::map<std::pair<std::string, expressionNode *>, symbolId> quasiIndex;
+        std::map<arena *, std::vector<symbolId>> quasiOwners;
+        std::vector<unsigned> freeQuasiSlots; // first slots of retired quasi terms
+    };
+
+    inline symbolTable &symbols() { return symbolTable::global(); }
+
+    // conjugate of a single symbol without going through the table for basic terms
+    expressionNode *conjugateSymbol(symbolId id);
+
     struct monomial
     {
-        mutable constTy coef = 1; // changing value of coef doesn't invalidate the order of monomials
-        void resetCoef(constTy _coef) const
-        {
-            coef = _coef;
-        }
+        constTy coef = 1;
 
-        std::map<std::string, std::pair<term *, int>> product;
+        exponentVector product;
 
         monomial() {}
-        monomial(constTy _coef, term *_term)
-            : coef(_coef)
+        monomial(constTy _coef, symbolId _symbol)
+            : coef(_coef), product(slotOf(_symbol), 1)
         {
-            product.insert({_term->name + (_term->hasConjugationMark ? "$" : ""), {_term, 1}});
         }
-        monomial(const constTy _coef, const std::map<std::string, std::pair<term *, int>> &_product)
+        monomial(const constTy _coef, const exponentVector &_product)
             : coef(_coef), product(_product)
         {
         }
@@ -205,7 +285,7 @@ namespace calc
 
         expressionNode *conj() const;
         monomial operator*(const monomial &other) const;
-        void operator*=(const constTy k) const;
+        void operator*=(const constTy k);
 
         const bool dividedBy(const monomial &divider) const;
         monomial divide(const monomial &divider) const;
@@ -219,7 +299,8 @@ namespace calc
         polyNode() {}
         polyNode(const monomial &mono)
         {
-            sum.insert(mono);
+            if (mono.coef != 0)
+                push(mono.product, mono.coef);
         }
 
         void operator+=(const monomial &mono);
@@ -232,13 +313,13 @@ namespace calc
         polyNode operator-(const polyNode &other) const;
 
         virtual expressionNode *add(expressionNode *second) const { return second->add(const_cast<polyNode *>(this)); }
-        virtual expressionNode *add(polyNode *secondPoly) const { return new polyNode(*this + *secondPoly); }
+        virtual expressionNode *add(polyNode *secondPoly) const { return makeNode<polyNode>(*this + *secondPoly); }
         virtual expressionNode *add(operationNode *secondOp) const
         {
             return secondOp->add(const_cast<polyNode *>(this));
         }
 
-        virtual expressionNode *multiply(constTy coef) const { return new polyNode(*this * coef); }
+        virtual expressionNode *multiply(constTy coef) const { return makeNode<polyNode>(*this * coef); }
 
         virtual expressionNode *multiply(expressionNode *second) const
         {
@@ -246,7 +327,7 @@ namespace calc
         }
         virtual expressionNode *multiply(polyNode *secondPoly) const
         {
-            return new polyNode((*this) * (*secondPoly));
+            return makeNode<polyNode>((*this) * (*secondPoly));
         }
         virtual expressionNode *multiply(operationNode *secondOp) const
         {
@@ -260,46 +341,43 @@ namespace calc
         virtual expressionNode *divide(polyNode *secondPoly, const bool isDivident = true) const;
         virtual expressionNode *divide(operationNode *secondOp, const bool isDivident = true) const;
 
-        virtual expressionNode *expandAddition(expressionNode *second) const
-        {
-            return second->expandAddition(const_cast<polyNode *>(this));
-        }
-        virtual expressionNode *expandAddition(polyNode *secondPoly) const
-        {
-            return add(secondPoly);
-        }
-        virtual expressionNode *expandAddition(operationNode *secondOp) const
-        {
-            return secondOp->expandAddition(const_cast<polyNode *>(this));
-        }
+        virtual expressionNode *expand() { return const_cast<polyNode *>(this); }
 
-        virtual expressionNode *expandMultiplication(expressionNode *second) const
-        {
-            return second->expandMultiplication(const_cast<polyNode *>(this));
-        }
-        virtual expressionNode *expandMultiplication(polyNode *secondPoly) const
-        {
-            return multiply(secondPoly);
-        }
-        virtual expressionNode *expandMultiplication(operationNode *secondOp) const
+    private:
+        // monomials sorted by their powers, coefficients are kept in separate real and imaginary arrays
+        arenaVector<exponentVector> powers;
+        arenaVector<int> re;
+        arenaVector<int> im;
+
+        void push(const exponentVector &product, constTy coef)
         {
-            return secondOp->expandMultiplication(const_cast<polyNode *>(this));
+            powers.push_back(product);
+            re.push_back(coef.real());
+            im.push_back(coef.imag());
         }
+        void reserve(size_t count);
+        void merge(const polyNode &first, size_t i, size_t iEnd, const polyNode &second, size_t j, size_t jEnd);
+        static polyNode multiplyRows(const polyNode &f, size_t first, size_t last, const polyNode &g);
 
-        virtual expressionNode *expand() { return const_cast<polyNode *>(this); }
+    public:
+        // operands below these sizes (terms of the sum, product of term counts) stay on one thread
+        static constexpr size_t parallelSumThreshold = size_t(1) << 16;
+        static constexpr size_t parallelProductThreshold = size_t(1) << 16;
 
-        virtual void print() const;
+        size_t size() const { return powers.size(); }
+        const exponentVector &powersAt(size_t index) const { return powers[index]; }
+        constTy coefAt(size_t index) const { return constTy(re[index], im[index]); }
+        monomial at(size_t index) const { return monomial(coefAt(index), powers[index]); }
 
-    private:
-        std::set<monomial> sum;
+        // polynomial from monomials in any order, like terms are combined
+        static polyNode collect(std::vector<monomial> terms);
 
-    public:
         const bool dividedBy(const monomial &divider) const;
 
         expressionNode *divide(const monomial &divider) const;
 
-        virtual const bool requiresBracketsPrinting() const { return sum.size() > 1; }
-        const bool checkZeroEquality() const { return sum.empty(); }
+        virtual const bool requiresBracketsPrinting() const { return size() > 1; }
+        const bool checkZeroEquality() const { return powers.empty(); }
     };
 
     polyNode *make_term(std::string name);
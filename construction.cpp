@@ -0,0 +1,136 @@
+#include "construction.h"
+
+using namespace calc;
+
+expr barycenter(expr A, expr B, expr C)
+{
+	return (A->add(B)->add(C))->divide(make_scalar(3));
+}
+
+expr sum(expr A, expr B, expr C)
+{
+	return (A->add(B)->add(C));
+};
+
+expr middlepoint(expr A, expr B)
+{
+	return (A->add(B))->divide(make_scalar(2));
+};
+
+expr linear_comb(expr A, expr kA, expr B, expr kB)
+{
+	return ((A->multiply(kA))->add(B->multiply(kB)));
+};
+
+// param A - center
+expr symm(expr A, expr B)
+{
+	return linear_comb(A, make_scalar(2), B, make_scalar(-1));
+};
+
+expr rotate90(expr A, expr B)
+{
+	return linear_comb(A, make_scalar(constTy(1, -1)), B, make_scalar(constTy(0, 1)));
+};
+
+expr rot_homothety(expr A, expr B, expr coef)
+{
+	return linear_comb(A, make_scalar(1)->substract(coef), B, coef);
+}
+
+/*
+X       Y
+conj(X) conj(Y)
+*/
+expr det(expr X, expr Y)
+{
+	return (X->multiply(Y->conj()))->substract(Y->multiply(X->conj()));
+};
+
+namespace
+{
+	const checkOptions defaultChecks;
+	thread_local const checkOptions *activeChecks = &defaultChecks;
+}
+
+const checkOptions &checkOptions::current()
+{
+	return *activeChecks;
+}
+
+checkOptions::scope::scope(const checkOptions &_options)
+	: previous(activeChecks)
+{
+	activeChecks = &_options;
+}
+
+checkOptions::scope::~scope()
+{
+	activeChecks = previous;
+}
+
+bool isZero(expr determinant)
+{
+	const checkOptions &options = checkOptions::current();
+	if (options.fastChecks)
+		return probablyZero(determinant, options.fastCheckOptions).isZero;
+	return slicedZero(determinant).isZero;
+}
+
+expr collinearity(expr A, expr B, expr C)
+{
+	return det(A, B)->add(det(B, C))->add(det(C, A));
+}
+
+bool collinear(expr A, expr B, expr C)
+{
+	expr detABC = collinearity(A, B, C);
+	if (const outputFormat *format = checkOptions::current().printedDeterminants)
+		serializer(std::cout, *format) << detABC << '\n';
+	return isZero(detABC);
+};
+
+line chord(expr X, expr Y)
+{
+	return { make_scalar(1), X->multiply(Y), X->add(Y) };
+}
+
+line tangent(expr X)
+{
+	return { make_scalar(1), X->multiply(X), X->multiply(make_scalar(2)) };
+}
+
+line by_two(expr X, expr Y)
+{
+	expr A = (X->conj())->substract(Y->conj());
+	expr B = Y->substract(X);
+	expr C = det(Y, X);
+	return { A, B, C };
+}
+
+expr intersect(line l1, line l2)
+{
+	expr nom = (l1.C->multiply(l2.B))->substract(l1.B->multiply(l2.C));
+	return nom->divide(parallelism(l1, l2));
+}
+
+expr parallelism(line l1, line l2)
+{
+	return (l1.A->multiply(l2.B))->substract(l1.B->multiply(l2.A));
+}
+
+expr concurrence(line l1, line l2, line l3)
+{
+	expr det1 = (l2.B->multiply(l3.C))->substract(l2.C->multiply(l3.B));
+	expr det2 = (l2.C->multiply(l3.A))->substract(l2.A->multiply(l3.C));
+	expr det3 = (l2.A->multiply(l3.B))->substract(l2.B->multiply(l3.A));
+	return (l1.A->multiply(det1))->add(l1.B->multiply(det2))->add(l1.C->multiply(det3));
+}
+
+bool concurrent(line l1, line l2, line l3)
+{
+	expr det123 = concurrence(l1, l2, l3);
+	if (const outputFormat *format = checkOptions::current().printedDeterminants)
+		serializer(std::cout, *format) << det123 << '\n';
+	return isZero(det123);
+}
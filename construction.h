@@ -0,0 +1,67 @@
+#pragma once
+
+#include "calculator.h"
+#include "serializer.h"
+#include "zerotest.h"
+
+// points of the complex plane, unit terms lie on the unit circle
+using expr = calc::expressionNode * ;
+
+// A z + B conj(z) = C
+struct line
+{
+	expr A, B, C;
+};
+
+expr barycenter(expr A, expr B, expr C);
+expr sum(expr A, expr B, expr C);
+expr middlepoint(expr A, expr B);
+expr linear_comb(expr A, expr kA, expr B, expr kB);
+// param A - center
+expr symm(expr A, expr B);
+expr rotate90(expr A, expr B);
+expr rot_homothety(expr A, expr B, expr coef);
+expr det(expr X, expr Y);
+
+// chords and tangents of the unit circle, X and Y on it
+line chord(expr X, expr Y);
+line tangent(expr X);
+line by_two(expr X, expr Y);
+expr intersect(line l1, line l2);
+
+// determinants vanishing exactly when the points are collinear or the lines concurrent
+expr collinearity(expr A, expr B, expr C);
+expr concurrence(line l1, line l2, line l3);
+// vanishing exactly when the lines are parallel or the same, intersect() divides by it
+expr parallelism(line l1, line l2);
+
+// isZero(), collinear() and concurrent() test their determinant slice by slice (see slicedZero() in zerotest.h) unless
+// fast checks are switched on, then it is evaluated at random points instead, see zerotest.h for the error bound
+// with a format set collinear() and concurrent() also print the determinant before checking it (see serializer.h)
+struct checkOptions
+{
+	bool fastChecks = false;
+	calc::zeroTestOptions fastCheckOptions;
+	const calc::outputFormat *printedDeterminants = nullptr;
+
+	// options of the running thread, the defaults outside of any scope
+	static const checkOptions &current();
+
+	// applies the options to the checks of the running thread for the lifetime of the scope
+	class scope
+	{
+	public:
+		explicit scope(const checkOptions &_options);
+		~scope();
+
+		scope(const scope &) = delete;
+		scope &operator=(const scope &) = delete;
+
+	private:
+		const checkOptions *previous;
+	};
+};
+
+bool isZero(expr determinant);
+bool collinear(expr A, expr B, expr C);
+bool concurrent(line l1, line l2, line l3);
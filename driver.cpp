@@ -0,0 +1,99 @@
+#include "driver.h"
+
+#include "arena.h"
+#include "hashcons.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace calc;
+
+namespace
+{
+    struct entryResult
+    {
+        std::string text;
+        bool failed = false;
+    };
+
+    entryResult process(const std::string &line, const expressionParser &parser, const batchDriverOptions &options)
+    {
+        const size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#')
+            return {};
+        // everything the entry builds lives in the arena of the worker and goes away with the scope
+        nodeCache shared;
+        nodeCache::scope sharing(shared);
+        std::optional<resultCache::scope> persisting;
+        if (options.cache)
+            persisting.emplace(*options.cache);
+        try
+        {
+            const expressionParser::equation parsed = parser.parseEquation(line);
+            if (!parsed.right)
+            {
+                std::ostringstream printed;
+                serializer(printed, *options.format) << parsed.left->expand();
+                return {printed.str()};
+            }
+            expressionNode *difference = parsed.left->substract(parsed.right);
+            const bool holds = options.fastChecks ? probablyZero(difference, options.fastCheckOptions).isZero
+                                                  : slicedZero(difference).isZero;
+            return {holds ? "1" : "0"};
+        }
+        catch (const std::exception &error)
+        {
+            return {std::string("error: ") + error.what(), true};
+        }
+    }
+}
+
+size_t calc::runBatchDriver(std::istream &in, std::ostream &out, const batchDriverOptions &options)
+{
+    expressionParser parser(options.undeclared);
+    const unsigned workers = threadCount();
+    std::vector<std::unique_ptr<arena>> arenas;
+    for (unsigned i = 0; i < workers; ++i)
+        arenas.push_back(std::make_unique<arena>());
+
+    std::vector<std::string> lines;
+    std::vector<entryResult> results;
+    std::string buffer;
+    size_t failed = 0;
+    while (in)
+    {
+        lines.clear();
+        std::string line;
+        while (lines.size() < options.chunkLines && std::getline(in, line))
+            lines.push_back(std::move(line));
+        if (lines.empty())
+            break;
+
+        // entries are taken one at a time, so a few expensive ones do not hold up a whole stripe
+        results.assign(lines.size(), entryResult());
+        std::atomic<size_t> next{0};
+        parallelFor(workers, [&](size_t worker)
+                    {
+                        for (size_t entry = next++; entry < lines.size(); entry = next++)
+                        {
+                            arena::scope query(*arenas[worker]);
+                            results[entry] = process(lines[entry], parser, options);
+                        } });
+
+        buffer.clear();
+        for (const entryResult &result : results)
+        {
+            buffer += result.text;
+            buffer += '\n';
+            failed += result.failed;
+        }
+        out.write(buffer.data(), buffer.size());
+    }
+    out.flush();
+    return failed;
+}
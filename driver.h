@@ -0,0 +1,33 @@
+#pragma once
+
+#include "parser.h"
+#include "resultcache.h"
+#include "serializer.h"
+#include "zerotest.h"
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+
+namespace calc
+{
+    struct batchDriverOptions
+    {
+        size_t chunkLines = 4096;         // lines read, processed and written at a time
+        bool fastChecks = false;          // identities are checked at random points (see zerotest.h)
+        zeroTestOptions fastCheckOptions;
+        termKind undeclared = termKind::UNIT;
+        const outputFormat *format = &plainFormat(); // of the expansions
+        resultCache *cache = nullptr;                // expansions are looked up and kept there (see resultcache.h)
+    };
+
+    // processes newline-delimited entries, writing one line per input line in input order:
+    //   an expression (see parser.h)    its expansion
+    //   lhs = rhs                       1 if the identity holds, 0 otherwise
+    //   blank or starting with "#"      an empty line
+    //   malformed                       "error: " and the reason
+    // entries are spread over the worker pool (see parallel.h); every worker expands in its own arena
+    // and node cache, released after each entry, and a chunk is written with a single call
+    // returns the number of entries that failed
+    size_t runBatchDriver(std::istream &in, std::ostream &out, const batchDriverOptions &options = {});
+}
@@ -0,0 +1,314 @@
+#include "encoding.h"
+
+#include "rational.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using namespace calc;
+
+namespace
+{
+    constexpr uint8_t magic = 'E';
+    constexpr uint8_t version = 1;
+
+    enum termKind : uint8_t
+    {
+        PLAIN,
+        CONJUGATED, // the conjugate partner of a plain term
+        REAL,
+        UNIT
+    };
+
+    void putVarint(std::vector<uint8_t> &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(uint8_t(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(uint8_t(value));
+    }
+
+    void putSigned(std::vector<uint8_t> &out, int64_t value)
+    {
+        putVarint(out, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+    }
+
+    class reader
+    {
+    public:
+        reader(const uint8_t *_data, size_t size) : data(_data), end(_data + size) {}
+
+        uint8_t byte()
+        {
+            if (data == end)
+                fail();
+            return *data++;
+        }
+
+        uint64_t varint()
+        {
+            uint64_t value = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7)
+            {
+                const uint8_t next = byte();
+                value |= uint64_t(next & 0x7F) << shift;
+                if (!(next & 0x80))
+                    return value;
+            }
+            fail();
+        }
+
+        int64_t signedVarint()
+        {
+            const uint64_t value = varint();
+            return int64_t(value >> 1) ^ -int64_t(value & 1);
+        }
+
+        std::string_view bytes(size_t count)
+        {
+            if (size_t(end - data) < count)
+                fail();
+            const char *start = reinterpret_cast<const char *>(data);
+            data += count;
+            return std::string_view(start, count);
+        }
+
+        bool done() const { return data == end; }
+
+        [[noreturn]] static void fail()
+        {
+            throw std::runtime_error("decodeExpansion: malformed data");
+        }
+
+    private:
+        const uint8_t *data;
+        const uint8_t *end;
+    };
+
+    // indices of the slots of one expansion in the order they are first met
+    class termTable
+    {
+    public:
+        // false for quasi terms
+        bool add(const polyNode &poly)
+        {
+            for (size_t i = 0; i < poly.size(); ++i)
+            {
+                bool named = true;
+                poly.powersAt(i).forEach([&](unsigned slot, int)
+                                         {
+                                             if (slot >= index.size())
+                                                 index.resize(slot + 1, none);
+                                             if (index[slot] != none)
+                                                 return;
+                                             named &= !isQuasi(symbols().symbolAt(slot));
+                                             index[slot] = uint32_t(slots.size());
+                                             slots.push_back(slot); });
+                if (!named)
+                    return false;
+            }
+            return true;
+        }
+
+        void write(std::vector<uint8_t> &out) const
+        {
+            putVarint(out, slots.size());
+            for (unsigned slot : slots)
+            {
+                const symbolId id = symbols().symbolAt(slot);
+                out.push_back(isUnit(id) ? UNIT : isReal(id) ? REAL : isConjugated(id) ? CONJUGATED : PLAIN);
+                const std::string &name = symbols().name(id);
+                putVarint(out, name.size());
+                out.insert(out.end(), name.begin(), name.end());
+            }
+        }
+
+        void write(std::vector<uint8_t> &out, const polyNode &poly) const
+        {
+            putVarint(out, poly.size());
+            for (size_t i = 0; i < poly.size(); ++i)
+            {
+                putSigned(out, poly.coefAt(i).real());
+                putSigned(out, poly.coefAt(i).imag());
+                const exponentVector &product = poly.powersAt(i);
+                size_t factors = 0;
+                product.forEach([&](unsigned, int)
+                                { ++factors; });
+                putVarint(out, factors);
+                product.forEach([&](unsigned slot, int power)
+                                {
+                                    putVarint(out, index[slot]);
+                                    putSigned(out, power); });
+            }
+        }
+
+    private:
+        static constexpr uint32_t none = ~uint32_t(0);
+        std::vector<uint32_t> index; // by slot
+        std::vector<unsigned> slots;
+    };
+
+    polyNode readPolynomial(reader &in, const std::vector<unsigned> &slots)
+    {
+        const uint64_t count = in.varint();
+        std::vector<monomial> terms;
+        terms.reserve(std::min<uint64_t>(count, 1 << 20));
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            const int64_t re = in.signedVarint(), im = in.signedVarint();
+            exponentVector product;
+            for (uint64_t factors = in.varint(); factors; --factors)
+            {
+                const uint64_t term = in.varint();
+                const int64_t power = in.signedVarint();
+                if (term >= slots.size() || power == 0 || power != int32_t(power))
+                    reader::fail();
+                product = product * exponentVector(slots[term], int(power));
+            }
+            if (re != int32_t(re) || im != int32_t(im))
+                reader::fail();
+            terms.emplace_back(constTy(int(re), int(im)), product);
+        }
+        // this process orders the slots differently, so the monomials are sorted again
+        return polyNode::collect(std::move(terms));
+    }
+
+    uint64_t mix(uint64_t value)
+    {
+        value += 0x9E3779B97F4A7C15ull;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    // the two halves of a key are mixed with different constants, so they are independent hashes
+    canonicalKey combine(canonicalKey key, uint64_t value)
+    {
+        return {mix(key.high ^ mix(value)), mix(key.low ^ mix(value ^ 0x5851F42D4C957F2Dull))};
+    }
+
+    class canonicalHasher
+    {
+    public:
+        canonicalKey of(const expressionNode *expression)
+        {
+            auto known = done.find(expression);
+            if (known != done.end())
+                return known->second;
+            canonicalKey key;
+            if (const polyNode *poly = dynamic_cast<const polyNode *>(expression))
+            {
+                // monomials are summed, so their order, which follows the slots, does not matter
+                key = combine({1, 1}, poly->size());
+                for (size_t i = 0; i < poly->size(); ++i)
+                {
+                    canonicalKey monomialKey = combine(combine({2, 2}, uint32_t(poly->coefAt(i).real())), uint32_t(poly->coefAt(i).imag()));
+                    canonicalKey factors;
+                    poly->powersAt(i).forEach([&](unsigned slot, int power)
+                                              {
+                                                  const canonicalKey factor = combine(term(slot), uint32_t(power));
+                                                  factors.high += factor.high;
+                                                  factors.low += factor.low; });
+                    monomialKey = combine(combine(monomialKey, factors.high), factors.low);
+                    key.high += monomialKey.high;
+                    key.low += monomialKey.low;
+                }
+            }
+            else
+            {
+                const operationNode *op = static_cast<const operationNode *>(expression);
+                const canonicalKey left = of(op->leftOperand()), right = of(op->rightOperand());
+                key = combine(combine(combine(combine({3, 3}, uint64_t(op->type())), left.high), left.low), right.high);
+                key = combine(key, right.low);
+            }
+            return done[expression] = key;
+        }
+
+    private:
+        canonicalKey term(unsigned slot)
+        {
+            if (slot < terms.size() && terms[slot].second)
+                return terms[slot].first;
+            const symbolId id = symbols().symbolAt(slot);
+            canonicalKey key = combine({4, 4}, id & (symbolBits::conjugationMark | symbolBits::real | symbolBits::unit | symbolBits::quasi));
+            for (char c : symbols().name(id))
+                key = combine(key, uint8_t(c));
+            // quasi terms of the same name differ by what they hide
+            if (isQuasi(id))
+            {
+                const canonicalKey hidden = of(static_cast<quasiTerm *>(symbols().lookup(id))->hidden());
+                key = combine(combine(key, hidden.high), hidden.low);
+            }
+            if (slot >= terms.size())
+                terms.resize(slot + 1);
+            terms[slot] = {key, true};
+            return key;
+        }
+
+        std::unordered_map<const expressionNode *, canonicalKey> done;
+        std::vector<std::pair<canonicalKey, bool>> terms;
+    };
+}
+
+bool calc::encodeExpansion(const expressionNode *expanded, std::vector<uint8_t> &out)
+{
+    const polyNode *numerator = dynamic_cast<const polyNode *>(expanded);
+    const polyNode *denominator = nullptr;
+    if (!numerator)
+    {
+        const operationNode *fraction = static_cast<const operationNode *>(expanded);
+        numerator = static_cast<const polyNode *>(fraction->leftOperand());
+        denominator = static_cast<const polyNode *>(fraction->rightOperand());
+    }
+    termTable table;
+    if (!table.add(*numerator) || (denominator && !table.add(*denominator)))
+        return false;
+    out.push_back(magic);
+    out.push_back(version);
+    table.write(out);
+    table.write(out, *numerator);
+    if (denominator)
+        table.write(out, *denominator);
+    else
+        putVarint(out, 0);
+    return true;
+}
+
+expressionNode *calc::decodeExpansion(const uint8_t *data, size_t size)
+{
+    reader in(data, size);
+    if (in.byte() != magic || in.byte() != version)
+        reader::fail();
+    const uint64_t count = in.varint();
+    if (count > size)
+        reader::fail();
+    // the terms are interned by name, wherever they sit in this process
+    std::vector<unsigned> slots;
+    slots.reserve(count);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        const uint8_t kind = in.byte();
+        if (kind > UNIT)
+            reader::fail();
+        const std::string name(in.bytes(in.varint()));
+        const symbolId id = symbols().intern(name, {kind == REAL, kind == UNIT});
+        slots.push_back(slotOf(kind == CONJUGATED ? id | symbolBits::conjugationMark : id));
+    }
+    const polyNode numerator = readPolynomial(in, slots);
+    const polyNode denominator = readPolynomial(in, slots);
+    if (!in.done())
+        reader::fail();
+    if (denominator.checkZeroEquality())
+        return makeNode<polyNode>(numerator);
+    return rationalFunction::ofCoprime(numerator, denominator).toExpression();
+}
+
+canonicalKey calc::canonicalHash(const expressionNode *expression)
+{
+    return canonicalHasher().of(expression);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "calculator.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace calc
+{
+    // compact binary form of expansions (a polyNode, or a DIVISION of two polyNodes as made by expand())
+    // that stays valid in other processes, where terms sit in other slots:
+    //   'E' version | term count | terms: kind, name length, name | numerator | denominator, empty for polynomials
+    //   polynomial: monomial count | monomials: real, imaginary, factor count | factors: term index, exponent
+    // terms are written once and referred to by index, every number is a varint, signed ones zigzag encoded
+    // appends to out; false, leaving out as it was, if a quasi term occurs, as it has no name outside of this process
+    bool encodeExpansion(const expressionNode *expanded, std::vector<uint8_t> &out);
+
+    // the expansion in the canonical form of rational.h, made in the active arena
+    // throws std::runtime_error on malformed data
+    expressionNode *decodeExpansion(const uint8_t *data, size_t size);
+
+    // 128-bit hash of an expression that is the same in every process:
+    // terms enter by kind and name rather than by slot, and monomials in any order
+    struct canonicalKey
+    {
+        uint64_t high = 0, low = 0;
+
+        bool operator==(const canonicalKey &other) const { return high == other.high && low == other.low; }
+        bool operator!=(const canonicalKey &other) const { return !(*this == other); }
+    };
+
+    canonicalKey canonicalHash(const expressionNode *expression);
+}
@@ -0,0 +1,65 @@
+#include "exponents.h"
+
+#include <algorithm>
+
+using namespace calc;
+
+exponentVector::exponentVector(unsigned slot, int power)
+    : degree(power)
+{
+    if (power == 0)
+        return;
+    if (slot < lanes::count && power >= INT8_MIN && power <= INT8_MAX)
+    {
+        packed[slot] = int8_t(power);
+        return;
+    }
+    wide.assign(std::max(slot + 1, lanes::count), 0);
+    wide[slot] = power;
+}
+
+exponentVector exponentVector::combineWide(const exponentVector &other, const bool subtract) const
+{
+    exponentVector result;
+    result.wide.resize(std::max(slotCount(), other.slotCount()));
+    for (unsigned slot = 0; slot < result.wide.size(); ++slot)
+        result.wide[slot] = subtract ? (*this)[slot] - other[slot] : (*this)[slot] + other[slot];
+    result.degree = subtract ? degree - other.degree : degree + other.degree;
+    result.pack();
+    return result;
+}
+
+bool exponentVector::dividedByWide(const exponentVector &divider) const
+{
+    const unsigned slots = std::max(slotCount(), divider.slotCount());
+    for (unsigned slot = 0; slot < slots; ++slot)
+        if ((*this)[slot] < divider[slot])
+            return false;
+    return true;
+}
+
+int exponentVector::compareWide(const exponentVector &other) const
+{
+    const unsigned slots = std::max(slotCount(), other.slotCount());
+    for (unsigned slot = 0; slot < slots; ++slot)
+    {
+        const int mine = (*this)[slot], theirs = other[slot];
+        if (mine != theirs)
+            return mine > theirs ? -1 : 1;
+    }
+    return 0;
+}
+
+void exponentVector::pack()
+{
+    for (unsigned slot = 0; slot < wide.size(); ++slot)
+    {
+        if (wide[slot] == 0)
+            continue;
+        if (slot >= lanes::count || wide[slot] < INT8_MIN || wide[slot] > INT8_MAX)
+            return;
+    }
+    for (unsigned slot = 0; slot < lanes::count; ++slot)
+        packed[slot] = int8_t(wide[slot]);
+    wide.clear();
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "arena.h"
+
+namespace calc
+{
+    // lane-wise kernels over the 32 packed 8-bit exponents of a monomial
+    // one AVX2 register or two SSE2 registers hold a whole monomial
+    namespace lanes
+    {
+        constexpr unsigned count = 32;
+
+        // out = a + b (a - b when subtracting), false if some lane does not fit 8 bits
+        inline bool combine(const int8_t *a, const int8_t *b, int8_t *out, const bool subtract)
+        {
+#if defined(__AVX2__)
+            const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+            const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+            const __m256i wrapped = subtract ? _mm256_sub_epi8(x, y) : _mm256_add_epi8(x, y);
+            const __m256i saturated = subtract ? _mm256_subs_epi8(x, y) : _mm256_adds_epi8(x, y);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), wrapped);
+            return _mm256_movemask_epi8(_mm256_cmpeq_epi8(wrapped, saturated)) == -1;
+#elif defined(__SSE2__)
+            int fits = 0xFFFF;
+            for (unsigned half = 0; half < count; half += 16)
+            {
+                const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + half));
+                const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + half));
+                const __m128i wrapped = subtract ? _mm_sub_epi8(x, y) : _mm_add_epi8(x, y);
+                const __m128i saturated = subtract ? _mm_subs_epi8(x, y) : _mm_adds_epi8(x, y);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + half), wrapped);
+                fits &= _mm_movemask_epi8(_mm_cmpeq_epi8(wrapped, saturated));
+            }
+            return fits == 0xFFFF;
+#else
+            bool fits = true;
+            for (unsigned i = 0; i < count; ++i)
+            {
+                const int value = subtract ? a[i] - b[i] : a[i] + b[i];
+                out[i] = int8_t(value);
+                fits &= (value >= INT8_MIN && value <= INT8_MAX);
+            }
+            return fits;
+#endif
+        }
+
+        // every lane of a is at least the matching lane of b
+        inline bool dominates(const int8_t *a, const int8_t *b)
+        {
+#if defined(__AVX2__)
+            const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+            const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+            return _mm256_movemask_epi8(_mm256_cmpgt_epi8(y, x)) == 0;
+#elif defined(__SSE2__)
+            int below = 0;
+            for (unsigned half = 0; half < count; half += 16)
+            {
+                const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + half));
+                const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + half));
+                below |= _mm_movemask_epi8(_mm_cmpgt_epi8(y, x));
+            }
+            return below == 0;
+#else
+            for (unsigned i = 0; i < count; ++i)
+                if (a[i] < b[i])
+                    return false;
+            return true;
+#endif
+        }
+
+        // index of the first lane where a and b differ, count if they are equal
+        inline unsigned firstDifference(const int8_t *a, const int8_t *b)
+        {
+#if defined(__AVX2__)
+            const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+            const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+            const uint32_t differ = ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+            return differ ? __builtin_ctz(differ) : count;
+#else
+            // word compare: the lowest differing byte of the xor is the first differing lane
+            for (unsigned word = 0; word < count; word += 8)
+            {
+                uint64_t x, y;
+                __builtin_memcpy(&x, a + word, 8);
+                __builtin_memcpy(&y, b + word, 8);
+                if (x != y)
+                    return word + (__builtin_ctzll(x ^ y) >> 3);
+            }
+            return count;
+#endif
+        }
+
+        inline bool isZero(const int8_t *a)
+        {
+            uint64_t any = 0;
+            for (unsigned word = 0; word < count; word += 8)
+            {
+                uint64_t x;
+                __builtin_memcpy(&x, a + word, 8);
+                any |= x;
+            }
+            return any == 0;
+        }
+    }
+
+    // exponents of a monomial indexed by symbol slot
+    // ordered by total degree, then by the earliest slot with the larger exponent, so the order survives multiplication
+    // the packed form keeps one signed byte per slot for the first lanes::count slots;
+    // exponents that overflow a byte, or slots past the packed width, switch to the wide form
+    class exponentVector
+    {
+    public:
+        exponentVector() {}
+        exponentVector(unsigned slot, int power);
+
+        int operator[](unsigned slot) const
+        {
+            if (isWide())
+                return slot < wide.size() ? wide[slot] : 0;
+            return slot < lanes::count ? packed[slot] : 0;
+        }
+
+        int totalDegree() const { return degree; }
+        bool empty() const { return !isWide() && lanes::isZero(packed); }
+        bool isWide() const { return !wide.empty(); }
+        unsigned slotCount() const { return isWide() ? unsigned(wide.size()) : lanes::count; }
+
+        // multiplication and division of monomials add and subtract exponents
+        exponentVector operator*(const exponentVector &other) const
+        {
+            exponentVector result;
+            if (isWide() || other.isWide() || !lanes::combine(packed, other.packed, result.packed, false))
+                return combineWide(other, false);
+            result.degree = degree + other.degree;
+            return result;
+        }
+        exponentVector operator/(const exponentVector &other) const
+        {
+            exponentVector result;
+            if (isWide() || other.isWide() || !lanes::combine(packed, other.packed, result.packed, true))
+                return combineWide(other, true);
+            result.degree = degree - other.degree;
+            return result;
+        }
+
+        bool dividedBy(const exponentVector &divider) const
+        {
+            if (isWide() || divider.isWide())
+                return dividedByWide(divider);
+            return lanes::dominates(packed, divider.packed);
+        }
+
+        int compare(const exponentVector &other) const
+        {
+            if (degree != other.degree)
+                return degree < other.degree ? -1 : 1;
+            if (isWide() || other.isWide())
+                return compareWide(other);
+            const unsigned lane = lanes::firstDifference(packed, other.packed);
+            if (lane == lanes::count)
+                return 0;
+            return packed[lane] > other.packed[lane] ? -1 : 1;
+        }
+        // hash of the exponents, equal vectors share it as each one has a single form
+        size_t hash() const
+        {
+            uint64_t h = uint64_t(degree) * 0x9E3779B97F4A7C15ull;
+            if (isWide())
+            {
+                // trailing zeros depend on how the vector was built
+                size_t used = wide.size();
+                while (used && wide[used - 1] == 0)
+                    --used;
+                for (size_t slot = 0; slot < used; ++slot)
+                    h = (h ^ uint32_t(wide[slot])) * 0x100000001B3ull;
+                return size_t(h ^ (h >> 29));
+            }
+            for (unsigned word = 0; word < lanes::count; word += 8)
+            {
+                uint64_t x;
+                __builtin_memcpy(&x, packed + word, 8);
+                h = (h ^ x) * 0x100000001B3ull;
+                h ^= h >> 32;
+            }
+            return size_t(h);
+        }
+
+        bool operator<(const exponentVector &other) const { return compare(other) < 0; }
+        bool operator==(const exponentVector &other) const { return compare(other) == 0; }
+
+        // visits the nonzero exponents in slot order
+        template <class F>
+        void forEach(F visit) const
+        {
+            const unsigned slots = slotCount();
+            for (unsigned slot = 0; slot < slots; ++slot)
+                if (const int power = (*this)[slot])
+                    visit(slot, power);
+        }
+
+    private:
+        exponentVector combineWide(const exponentVector &other, const bool subtract) const;
+        bool dividedByWide(const exponentVector &divider) const;
+        int compareWide(const exponentVector &other) const;
+        void pack(); // returns to the packed form whenever every exponent fits it
+
+        int32_t degree = 0;
+        int8_t packed[lanes::count] = {};
+        arenaVector<int32_t> wide;
+    };
+}
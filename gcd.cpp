@@ -0,0 +1,543 @@
+#include "gcd.h"
+
+#include "modular.h"
+
+#include <map>
+#include <optional>
+#include <vector>
+
+using namespace calc;
+
+namespace
+{
+    // univariate polynomials over Z_p[i] by increasing degree, without trailing zeros
+    using dense = std::vector<constTy>;
+
+    // primes tried for lifting a common factor before it is given up
+    constexpr size_t maxPrimes = 3;
+    // evaluations allowed per gcd, the dense algorithm grows with the degree in every variable
+    constexpr size_t maxImages = 4096;
+    constexpr int maxLiftedCoef = 1 << 15;
+
+    constTy addMod(constTy a, constTy b, uint32_t p)
+    {
+        return constTy(reduceMod(int64_t(a.real()) + b.real(), p), reduceMod(int64_t(a.imag()) + b.imag(), p));
+    }
+
+    constTy subMod(constTy a, constTy b, uint32_t p)
+    {
+        return constTy(reduceMod(int64_t(a.real()) - b.real(), p), reduceMod(int64_t(a.imag()) - b.imag(), p));
+    }
+
+    // representative with both parts in (-p/2, p/2)
+    constTy symmetric(constTy a, uint32_t p)
+    {
+        return constTy(a.real() > int(p / 2) ? int(a.real() - int64_t(p)) : a.real(),
+                       a.imag() > int(p / 2) ? int(a.imag() - int64_t(p)) : a.imag());
+    }
+
+    // round(x / n) for n > 0, wide enough for products of two int coefficients
+    __int128 nearest(__int128 x, __int128 n)
+    {
+        const __int128 twice = 2 * x + n;
+        return twice >= 0 ? twice / (2 * n) : -((-twice + 2 * n - 1) / (2 * n));
+    }
+
+    // exact quotient of coefficients, in Z_p[i] if p is set
+    bool divideCoef(constTy a, constTy b, uint32_t p, constTy &quotient)
+    {
+        if (p)
+        {
+            quotient = mulMod(a, inverseMod(b, p), p);
+            return true;
+        }
+        // a norm of two int parts needs 63 bits, their sums one more
+        const __int128 norm = __int128(b.real()) * b.real() + __int128(b.imag()) * b.imag();
+        const __int128 re = __int128(a.real()) * b.real() + __int128(a.imag()) * b.imag();
+        const __int128 im = __int128(a.imag()) * b.real() - __int128(a.real()) * b.imag();
+        if (re % norm || im % norm)
+            return false;
+        quotient = constTy(int(re / norm), int(im / norm));
+        return true;
+    }
+
+    void trim(dense &a)
+    {
+        while (!a.empty() && a.back() == constTy(0))
+            a.pop_back();
+    }
+
+    // remainder of the division by a nonzero b, the quotient is stored if asked for
+    dense remainder(dense a, const dense &b, uint32_t p, dense *quotient = nullptr)
+    {
+        const constTy inverse = inverseMod(b.back(), p);
+        if (quotient)
+            quotient->assign(a.size() >= b.size() ? a.size() - b.size() + 1 : 0, constTy(0));
+        while (a.size() >= b.size())
+        {
+            const size_t shift = a.size() - b.size();
+            const constTy factor = mulMod(a.back(), inverse, p);
+            if (quotient)
+                (*quotient)[shift] = factor;
+            for (size_t k = 0; k + 1 < b.size(); ++k)
+                a[shift + k] = subMod(a[shift + k], mulMod(factor, b[k], p), p);
+            a.pop_back();
+            trim(a);
+        }
+        return a;
+    }
+
+    dense monic(dense a, uint32_t p)
+    {
+        if (a.empty())
+            return a;
+        const constTy inverse = inverseMod(a.back(), p);
+        for (constTy &coef : a)
+            coef = mulMod(coef, inverse, p);
+        return a;
+    }
+
+    dense gcdDense(dense a, dense b, uint32_t p)
+    {
+        while (!b.empty())
+        {
+            dense rest = remainder(a, b, p);
+            a = std::move(b);
+            b = std::move(rest);
+        }
+        return monic(a, p);
+    }
+
+    dense multiplyDense(const dense &a, const dense &b, uint32_t p)
+    {
+        dense result(a.size() + b.size() - 1, constTy(0));
+        for (size_t i = 0; i < a.size(); ++i)
+            for (size_t j = 0; j < b.size(); ++j)
+                result[i + j] = addMod(result[i + j], mulMod(a[i], b[j], p), p);
+        return result;
+    }
+
+    constTy evaluateDense(const dense &a, constTy x, uint32_t p)
+    {
+        constTy value = 0;
+        for (size_t k = a.size(); k-- > 0;)
+            value = addMod(mulMod(value, x, p), a[k], p);
+        return value;
+    }
+
+    // a as a polynomial in the other variables with coefficients in Z_p[y]
+    std::map<exponentVector, dense> split(const polyNode &a, unsigned y, uint32_t p)
+    {
+        std::map<exponentVector, dense> parts;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            const int power = a.powersAt(i)[y];
+            dense &part = parts[a.powersAt(i) / exponentVector(y, power)];
+            if (part.size() <= size_t(power))
+                part.resize(power + 1, constTy(0));
+            part[power] = reduceMod(a.coefAt(i), p);
+        }
+        return parts;
+    }
+
+    polyNode join(const std::map<exponentVector, dense> &parts, unsigned y)
+    {
+        std::vector<monomial> terms;
+        for (const auto &[rest, part] : parts)
+            for (size_t power = 0; power < part.size(); ++power)
+                if (part[power] != constTy(0))
+                    terms.emplace_back(part[power], rest * exponentVector(y, int(power)));
+        return polyNode::collect(std::move(terms));
+    }
+
+    polyNode univariate(const dense &a, unsigned y)
+    {
+        return join({{exponentVector(), a}}, y);
+    }
+
+    size_t degreeIn(const std::map<exponentVector, dense> &parts)
+    {
+        size_t degree = 0;
+        for (const auto &[rest, part] : parts)
+            degree = std::max(degree, part.size() - 1);
+        return degree;
+    }
+
+    // content in Z_p[y] is divided out, and returned
+    dense removeContent(std::map<exponentVector, dense> &parts, uint32_t p)
+    {
+        dense content;
+        for (const auto &[rest, part] : parts)
+            content = gcdDense(content, part, p);
+        for (auto &[rest, part] : parts)
+        {
+            dense quotient;
+            remainder(part, content, p, &quotient);
+            part = std::move(quotient);
+        }
+        return content;
+    }
+
+    polyNode evaluate(const polyNode &a, unsigned y, constTy x, uint32_t p)
+    {
+        std::vector<monomial> terms;
+        terms.reserve(a.size());
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            const int power = a.powersAt(i)[y];
+            terms.emplace_back(mulMod(a.coefAt(i), powMod(x, power, p), p), a.powersAt(i) / exponentVector(y, power));
+        }
+        return polyNode::collect(std::move(terms));
+    }
+
+    polyNode monic(const polyNode &a, uint32_t p)
+    {
+        if (a.checkZeroEquality())
+            return a;
+        return a * inverseMod(a.coefAt(a.size() - 1), p);
+    }
+
+    bool isOne(const polyNode &a)
+    {
+        return a.size() == 1 && a.powersAt(0).empty() && a.coefAt(0) == constTy(1);
+    }
+
+    std::vector<unsigned> variables(const polyNode &a, const polyNode &b)
+    {
+        std::vector<unsigned> found;
+        for (const polyNode *poly : {&a, &b})
+            for (size_t i = 0; i < poly->size(); ++i)
+                poly->powersAt(i).forEach([&](unsigned slot, int)
+                                          { found.push_back(slot); });
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+        return found;
+    }
+
+    // smallest exponent of every slot over the monomials of a, the monomial content
+    exponentVector lowest(const polyNode &a)
+    {
+        unsigned slots = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+            slots = std::max(slots, a.powersAt(i).slotCount());
+        exponentVector result;
+        for (unsigned slot = 0; slot < slots; ++slot)
+        {
+            int power = a.powersAt(0)[slot];
+            for (size_t i = 1; i < a.size(); ++i)
+                power = std::min(power, a.powersAt(i)[slot]);
+            if (power)
+                result = result * exponentVector(slot, power);
+        }
+        return result;
+    }
+
+    exponentVector lowest(const exponentVector &a, const exponentVector &b)
+    {
+        exponentVector result;
+        for (unsigned slot = 0; slot < std::max(a.slotCount(), b.slotCount()); ++slot)
+            if (const int power = std::min(a[slot], b[slot]))
+                result = result * exponentVector(slot, power);
+        return result;
+    }
+
+    constTy content(const polyNode &a)
+    {
+        constTy result = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+            result = gcd(result, a.coefAt(i));
+        return result;
+    }
+
+    polyNode primitive(const polyNode &a, constTy content)
+    {
+        std::vector<monomial> terms;
+        terms.reserve(a.size());
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            constTy coef;
+            divideCoef(a.coefAt(i), content, 0, coef);
+            terms.emplace_back(coef, a.powersAt(i));
+        }
+        return polyNode::collect(std::move(terms));
+    }
+
+    // polynomial long division by leading terms, the divisor must be nonzero
+    bool dividePolynomial(const polyNode &dividend, const polyNode &divisor, polyNode &quotient)
+    {
+        const uint32_t p = activeModulus();
+        const exponentVector &lead = divisor.powersAt(divisor.size() - 1);
+        const constTy leadCoef = divisor.coefAt(divisor.size() - 1);
+        // the lowest monomial of the quotient is known, nothing below it can appear
+        const int lowestDegree = dividend.powersAt(0).totalDegree() - divisor.powersAt(0).totalDegree();
+        std::vector<monomial> terms;
+        if (divisor.size() == 1)
+        {
+            // a single term divides every monomial on its own
+            terms.reserve(dividend.size());
+            for (size_t i = 0; i < dividend.size(); ++i)
+            {
+                constTy factor;
+                if (!dividend.powersAt(i).dividedBy(lead) || !divideCoef(dividend.coefAt(i), leadCoef, p, factor))
+                    return false;
+                terms.emplace_back(factor, dividend.powersAt(i) / lead);
+            }
+            quotient = polyNode::collect(std::move(terms));
+            return true;
+        }
+        polyNode rest = dividend;
+        while (!rest.checkZeroEquality())
+        {
+            const exponentVector &top = rest.powersAt(rest.size() - 1);
+            if (!top.dividedBy(lead) || top.totalDegree() - lead.totalDegree() < lowestDegree)
+                return false;
+            constTy factor;
+            if (!divideCoef(rest.coefAt(rest.size() - 1), leadCoef, p, factor))
+                return false;
+            const monomial step(factor, top / lead);
+            terms.push_back(step);
+            rest = rest - divisor * step;
+        }
+        quotient = polyNode::collect(std::move(terms));
+        return true;
+    }
+
+    // trial division runs in int coefficients, wrong lifts with huge coefficients are rejected before they overflow it
+    bool fitsTrialDivision(const polyNode &a)
+    {
+        for (size_t i = 0; i < a.size(); ++i)
+            if (std::abs(a.coefAt(i).real()) > maxLiftedCoef || std::abs(a.coefAt(i).imag()) > maxLiftedCoef)
+                return false;
+        return true;
+    }
+
+    // Brown's dense modular gcd over Z_p[i], to be run inside a modular scope
+    // the last variable is eliminated by evaluation, the gcd of the images is interpolated back with Newton's formula
+    // images are scaled to the gcd of the leading coefficients, which the gcd must divide
+    class brownGcd
+    {
+    public:
+        explicit brownGcd(uint32_t _p)
+            : p(_p)
+        {
+        }
+
+        // monic gcd, nothing if the evaluation budget runs out
+        std::optional<polyNode> of(const polyNode &a, const polyNode &b, std::vector<unsigned> variables)
+        {
+            if (a.checkZeroEquality())
+                return monic(b, p);
+            if (b.checkZeroEquality())
+                return monic(a, p);
+            if (variables.empty())
+                return polyNode(monomial(1, exponentVector()));
+            const unsigned y = variables.back();
+            variables.pop_back();
+            std::map<exponentVector, dense> partsA = split(a, y, p), partsB = split(b, y, p);
+            if (variables.empty())
+                return univariate(gcdDense(partsA.begin()->second, partsB.begin()->second, p), y);
+
+            const dense common = gcdDense(removeContent(partsA, p), removeContent(partsB, p), p);
+            const dense &leadA = partsA.rbegin()->second, &leadB = partsB.rbegin()->second;
+            const dense gamma = gcdDense(leadA, leadB, p);
+            const polyNode primitiveA = join(partsA, y), primitiveB = join(partsB, y);
+            const size_t bound = gamma.size() - 1 + std::min(degreeIn(partsA), degreeIn(partsB));
+
+            polyNode interpolated;
+            exponentVector leading;
+            dense vanishing;
+            size_t points = 0;
+            for (int x = 1; points <= bound + 2; ++x)
+            {
+                const constTy at(x, 0);
+                if (evaluateDense(leadA, at, p) == constTy(0) || evaluateDense(leadB, at, p) == constTy(0))
+                    continue;
+                if (++images > maxImages)
+                    return std::nullopt;
+                std::optional<polyNode> image = of(evaluate(primitiveA, y, at, p), evaluate(primitiveB, y, at, p), variables);
+                if (!image)
+                    return std::nullopt;
+                // coprime images at a point where no leading coefficient vanishes: the primitive parts are coprime
+                if (isOne(*image))
+                    return monic(univariate(common, y), p);
+                const exponentVector &lead = image->powersAt(image->size() - 1);
+                if (points && leading < lead)
+                    continue;
+                const polyNode scaled = *image * evaluateDense(gamma, at, p);
+                bool unchanged = false;
+                if (!points || lead < leading)
+                {
+                    // first point, or every earlier one was unlucky
+                    interpolated = scaled;
+                    leading = lead;
+                    vanishing = {subMod(0, at, p), constTy(1)};
+                    points = 1;
+                }
+                else
+                {
+                    const polyNode difference = scaled - evaluate(interpolated, y, at, p);
+                    unchanged = difference.checkZeroEquality();
+                    if (!unchanged)
+                    {
+                        dense step = vanishing;
+                        const constTy inverse = inverseMod(evaluateDense(vanishing, at, p), p);
+                        for (constTy &coef : step)
+                            coef = mulMod(coef, inverse, p);
+                        interpolated = interpolated + difference * univariate(step, y);
+                    }
+                    vanishing = multiplyDense(vanishing, {subMod(0, at, p), constTy(1)}, p);
+                    ++points;
+                }
+                if (!unchanged && points <= bound)
+                    continue;
+                // the primitive part of the interpolation is the candidate, division decides
+                std::map<exponentVector, dense> parts = split(interpolated, y, p);
+                removeContent(parts, p);
+                const polyNode candidate = join(parts, y);
+                polyNode quotient;
+                if (divideExact(primitiveA, candidate, quotient) && divideExact(primitiveB, candidate, quotient))
+                    return monic(candidate * univariate(common, y), p);
+            }
+            return std::nullopt;
+        }
+
+    private:
+        const uint32_t p;
+        size_t images = 0;
+    };
+}
+
+constTy calc::gcd(constTy a, constTy b)
+{
+    // remainders never grow, but norms and cross products of int parts overflow 64 bits
+    __int128 ar = a.real(), ai = a.imag(), br = b.real(), bi = b.imag();
+    while (br || bi)
+    {
+        // Euclid's algorithm with the quotient rounded to the nearest Gaussian integer
+        const __int128 norm = br * br + bi * bi;
+        const __int128 qr = nearest(ar * br + ai * bi, norm), qi = nearest(ai * br - ar * bi, norm);
+        const __int128 rr = ar - (qr * br - qi * bi), ri = ai - (qr * bi + qi * br);
+        ar = br;
+        ai = bi;
+        br = rr;
+        bi = ri;
+    }
+    // multiplying by i turns through the quadrants
+    while (ar <= 0 && (ar || ai))
+    {
+        const __int128 turned = -ai;
+        ai = ar;
+        ar = turned;
+    }
+    if (ai < 0)
+    {
+        const __int128 turned = -ai;
+        ai = ar;
+        ar = turned;
+    }
+    return constTy(int(ar), int(ai));
+}
+
+exponentVector calc::monomialContent(const polyNode &a)
+{
+    return lowest(a);
+}
+
+bool calc::divideExact(const polyNode &dividend, const polyNode &divisor, polyNode &quotient)
+{
+    metricTimer timer(metricKind::DIVIDE);
+    if (divisor.checkZeroEquality())
+        return false;
+    if (dividend.checkZeroEquality())
+    {
+        quotient = polyNode();
+        return true;
+    }
+    // monomials are units, both sides are shifted to polynomials without monomial content
+    const exponentVector shiftA = lowest(dividend), shiftB = lowest(divisor);
+    if (shiftA.empty() && shiftB.empty())
+    {
+        const bool divided = dividePolynomial(dividend, divisor, quotient);
+        timer.produced(divided ? quotient.size() : 0);
+        return divided;
+    }
+    polyNode shifted;
+    if (!dividePolynomial(dividend * monomial(1, exponentVector() / shiftA), divisor * monomial(1, exponentVector() / shiftB), shifted))
+        return false;
+    quotient = shifted * monomial(1, shiftA / shiftB);
+    timer.produced(quotient.size());
+    return true;
+}
+
+namespace
+{
+    polyNode gcdOfPolynomials(const polyNode &a, const polyNode &b)
+    {
+        if (a.checkZeroEquality())
+            return b;
+        if (b.checkZeroEquality())
+            return a;
+        const exponentVector shiftA = lowest(a), shiftB = lowest(b);
+        const exponentVector shift = lowest(shiftA, shiftB);
+        const polyNode shiftedA = a * monomial(1, exponentVector() / shiftA), shiftedB = b * monomial(1, exponentVector() / shiftB);
+        // residues: the monic gcd modulo p, the image of the exact gcd divided by its leading coefficient,
+        // so a quotient by it is the image of an integer polynomial, the same one for every lucky prime
+        if (const uint32_t p = activeModulus())
+        {
+            if (shiftedA.size() == 1 || shiftedB.size() == 1)
+                return polyNode(monomial(1, shift));
+            const std::optional<polyNode> image = brownGcd(p).of(shiftedA, shiftedB, variables(shiftedA, shiftedB));
+            return (image ? *image : polyNode(monomial(1, exponentVector()))) * monomial(1, shift);
+        }
+
+        const constTy contentA = content(shiftedA), contentB = content(shiftedB);
+        const polyNode primitiveA = primitive(shiftedA, contentA), primitiveB = primitive(shiftedB, contentB);
+        const monomial outside(gcd(contentA, contentB), shift);
+        // without monomial content, a single term is a constant
+        if (primitiveA.size() == 1 || primitiveB.size() == 1)
+            return polyNode(outside);
+
+        // the leading coefficient of the gcd divides both leading coefficients, so scaling by their gcd keeps it integral
+        const constTy leadA = primitiveA.coefAt(primitiveA.size() - 1), leadB = primitiveB.coefAt(primitiveB.size() - 1);
+        const constTy gamma = gcd(leadA, leadB);
+        const std::vector<unsigned> slots = variables(primitiveA, primitiveB);
+        size_t tried = 0;
+        for (uint32_t p : modularPrimes())
+        {
+            if (tried == maxPrimes)
+                break;
+            if (reduceMod(leadA, p) == constTy(0) || reduceMod(leadB, p) == constTy(0))
+                continue;
+            ++tried;
+            std::vector<monomial> lifted;
+            {
+                modularScope residues(p);
+                const std::optional<polyNode> image = brownGcd(p).of(primitiveA, primitiveB, slots);
+                if (!image)
+                    continue;
+                // modulo a prime keeping the leading coefficients the degree of the gcd can only rise,
+                // so a constant image proves the primitive parts coprime
+                if (isOne(*image))
+                    return polyNode(outside);
+                for (size_t i = 0; i < image->size(); ++i)
+                    lifted.emplace_back(symmetric(mulMod(image->coefAt(i), gamma, p), p), image->powersAt(i));
+            }
+            const polyNode candidate = polyNode::collect(std::move(lifted));
+            const polyNode factor = primitive(candidate, content(candidate));
+            if (!fitsTrialDivision(factor))
+                continue;
+            polyNode quotient;
+            if (divideExact(primitiveA, factor, quotient) && divideExact(primitiveB, factor, quotient))
+                return factor * outside;
+        }
+        return polyNode(outside);
+    }
+}
+
+polyNode calc::gcd(const polyNode &a, const polyNode &b)
+{
+    metricTimer timer(metricKind::GCD);
+    polyNode result = gcdOfPolynomials(a, b);
+    timer.produced(result.size());
+    return result;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "calculator.h"
+
+namespace calc
+{
+    // greatest common divisor of two polynomials over the Gaussian integers, up to a unit
+    // the gcd of the primitive parts is found modulo a word-sized prime with Brown's dense modular algorithm,
+    // lifted to Z[i] and confirmed by exact division; a factor that cannot be confirmed is left out,
+    // so the result always divides both operands
+    // inside a modular scope (see modular.h) the gcd is taken over Z_p[i] and made monic, times the monomial content;
+    // only the monomial content is left if the evaluation budget runs out
+    polyNode gcd(const polyNode &a, const polyNode &b);
+
+    // quotient of an exact division of Laurent polynomials, false if divisor does not divide dividend
+    // monomials are units, so the quotient may have negative exponents
+    // coefficients are divided in Z[i], or in Z_p[i] inside a modular scope
+    bool divideExact(const polyNode &dividend, const polyNode &divisor, polyNode &quotient);
+
+    // smallest exponent of every slot over the monomials of a nonzero polynomial
+    exponentVector monomialContent(const polyNode &a);
+
+    // gcd of Gaussian integers, normalised to the associate with positive real and nonnegative imaginary part
+    constTy gcd(constTy a, constTy b);
+}
@@ -1,109 +1,126 @@
 #include "calculator.h"
+#include "construction.h"
+#include "driver.h"
+#include "hashcons.h"
+#include "parser.h"
+#include "serializer.h"
+#include "theorem.h"
 
-using namespace calc;
-
-// *
-
-using expr = expressionNode * ;
-
-expr barycenter(expr A, expr B, expr C)
-{
-	return (A->add(B)->add(C))->divide(make_scalar(3));
-}
-
-expr sum(expr A, expr B, expr C)
-{
-	return (A->add(B)->add(C));
-};
-
-expr middlepoint(expr A, expr B)
-{
-	return (A->add(B))->divide(make_scalar(2));
-};
+#include <cstdlib>
+#include <fstream>
+#include <optional>
 
-expr linear_comb(expr A, expr kA, expr B, expr kB)
-{
-	return ((A->multiply(kA))->add(B->multiply(kB)));
-};
-
-// param A - center
-expr symm(expr A, expr B)
-{
-	return linear_comb(A, make_scalar(2), B, make_scalar(-1));
-};
-
-expr rotate90(expr A, expr B)
-{
-	return linear_comb(A, make_scalar(constTy(1, -1)), B, make_scalar(constTy(0, 1)));
-};
-
-expr rot_homothety(expr A, expr B, expr coef)
-{
-	return linear_comb(A, make_scalar(1)->substract(coef), B, coef);
-}
-
-/*
-X       Y
-conj(X) conj(Y)
-*/
-expr det(expr X, expr Y)
-{
-	return (X->multiply(Y->conj()))->substract(Y->multiply(X->conj()));
-};
-
-bool collinear(expr A, expr B, expr C)
-{
-	expr detABC = det(A, B)->add(det(B, C))->add(det(C, A));
-	detABC->print();
-	std::cout << std::endl;
-	return detABC->expand()->checkZeroEquality();
-};
-
-struct line
-{
-	expr A, B, C;
-};
-
-line chord(expr X, expr Y)
-{
-	return { make_scalar(1), X->multiply(Y), X->add(Y) };
-}
-
-line tangent(expr X)
-{
-	return { make_scalar(1), X->multiply(X), X->multiply(make_scalar(2)) };
-}
-
-line by_two(expr X, expr Y)
-{
-	expr A = (X->conj())->substract(Y->conj());
-	expr B = Y->substract(X);
-	expr C = det(Y, X);
-	return { A, B, C };
-}
-
-expr intersect(line l1, line l2)
-{
-	expr nom = (l1.C->multiply(l2.B))->substract(l1.B->multiply(l2.C));
-	expr denom = (l1.A->multiply(l2.B))->substract(l1.B->multiply(l2.A));
-	return nom->divide(denom);
-}
-
-bool concurrent(line l1, line l2, line l3)
-{
-	expr det1 = (l2.B->multiply(l3.C))->substract(l2.C->multiply(l3.B));
-	expr det2 = (l2.C->multiply(l3.A))->substract(l2.A->multiply(l3.C));
-	expr det3 = (l2.A->multiply(l3.B))->substract(l2.B->multiply(l3.A));
-	expr det123 = (l1.A->multiply(det1))->add(l1.B->multiply(det2))->add(l1.C->multiply(det3));
-	det123->print();
-	std::cout << std::endl;
-	return det123->expand()->checkZeroEquality();
-}
-
-expressionNode *parseString(const std::string &line, size_t l, size_t r);
+using namespace calc;
 
-int main()
-{
+int main(int argc, char **argv)
+{
+	// expansions of earlier runs: --cache file, for --batch and --run, keeps them in the file (see resultcache.h)
+	std::optional<resultCache> cache;
+	auto openCache = [&](const char *path)
+	{
+		try
+		{
+			cache.emplace(path);
+			return &*cache;
+		}
+		catch (const std::exception &error)
+		{
+			std::cerr << error.what() << std::endl;
+			std::exit(1);
+		}
+	};
+	// batch mode: brianchon --batch [--fast] [--latex | --compact] [--cache file] [file], one entry per line of the file or of stdin (see driver.h)
+	if (argc > 1 && std::string(argv[1]) == "--batch")
+	{
+		batchDriverOptions options;
+		int next = 2;
+		for (; next < argc && std::string(argv[next]).rfind("--", 0) == 0; ++next)
+		{
+			const std::string flag = argv[next];
+			if (flag == "--fast")
+				options.fastChecks = true;
+			else if (flag == "--latex")
+				options.format = &latexFormat();
+			else if (flag == "--compact")
+				options.format = &compactFormat();
+			else if (flag == "--cache" && next + 1 < argc)
+				options.cache = openCache(argv[++next]);
+			else
+				break;
+		}
+		std::ios::sync_with_stdio(false);
+		if (next < argc)
+		{
+			std::ifstream file(argv[next]);
+			if (!file)
+			{
+				std::cerr << "cannot open " << argv[next] << std::endl;
+				return 1;
+			}
+			return runBatchDriver(file, std::cout, options) ? 2 : 0;
+		}
+		return runBatchDriver(std::cin, std::cout, options) ? 2 : 0;
+	}
+	// theorem scripts: brianchon --run [--fast] [--metrics text|json|prometheus] [--cache file] directory, every *.thm file in it is checked (see theorem.h)
+	// with --metrics the counters of metrics.h are reported per script, json as one object per line,
+	// prometheus as a single exposition on stdout with the verdicts moved to stderr
+	if (argc > 1 && std::string(argv[1]) == "--run")
+	{
+		theoremOptions options;
+		std::string format;
+		int next = 2;
+		for (; next < argc && std::string(argv[next]).rfind("--", 0) == 0; ++next)
+		{
+			const std::string flag = argv[next];
+			if (flag == "--fast")
+				options.fastChecks = true;
+			else if (flag == "--metrics" && next + 1 < argc)
+				format = argv[++next];
+			else if (flag == "--cache" && next + 1 < argc)
+				options.cache = openCache(argv[++next]);
+			else
+				break;
+		}
+		const bool known = format.empty() || format == "text" || format == "json" || format == "prometheus";
+		if (next + 1 != argc || !known)
+		{
+			std::cerr << "usage: " << argv[0] << " --run [--fast] [--metrics text|json|prometheus] [--cache file] directory" << std::endl;
+			return 1;
+		}
+		options.collectMetrics = !format.empty();
+		bool allHold = true;
+		std::vector<std::pair<std::string, metricsReport>> reports;
+		for (const theoremResult &result : runTheoremDirectory(argv[next], options))
+		{
+			const std::string verdict = !result.error.empty() ? "error: " + result.error : result.holds ? "holds" : "fails";
+			allHold &= result.error.empty() && result.holds;
+			std::string quoted;
+			for (char c : result.name)
+				quoted += c == '"' || c == '\\' ? std::string("\\") + c : std::string(1, c);
+			if (format == "json")
+			{
+				std::cout << "{\"theorem\": \"" << quoted << "\", \"result\": \"" << (!result.error.empty() ? "error" : result.holds ? "holds" : "fails") << "\""
+						  << ", \"seconds\": " << result.seconds << ", \"metrics\": ";
+				result.metrics.printJson(std::cout);
+				std::cout << "}" << std::endl;
+				continue;
+			}
+			(format == "prometheus" ? std::cerr : std::cout) << result.name << ": " << verdict << " (" << result.seconds << "s)" << std::endl;
+			if (format == "text")
+				result.metrics.print(std::cout);
+			else if (format == "prometheus")
+				reports.push_back({"theorem=\"" + quoted + "\"", result.metrics});
+		}
+		if (format == "prometheus")
+			printPrometheus(std::cout, reports);
+		return allHold ? 0 : 2;
+	}
+	// every node built below belongs to this query and is released at once on exit
+	arena proofArena;
+	arena::scope query(proofArena);
+	// equal subexpressions are built, conjugated and expanded once
+	nodeCache shared;
+	nodeCache::scope sharing(shared);
 	// TESTS
 	auto a = make_unit_term("a");
 	auto b = make_unit_term("b");
@@ -207,11 +224,11 @@ int main()
 	line third = by_two(intersect(C, D), intersect(A, F));
 	std::cout << concurrent(first, second, third) << std::endl;
 	*/
-	// g++ geometry.cpp calculator.h calculator.cpp -o brianchon
+	// g++ geometry.cpp calculator.h calculator.cpp arena.cpp exponents.cpp parallel.cpp modular.cpp gcd.cpp rational.cpp hashcons.cpp zerotest.cpp straightline.cpp batch.cpp parser.cpp driver.cpp construction.cpp theorem.cpp metrics.cpp serializer.cpp encoding.cpp resultcache.cpp -pthread -o brianchon
 	/*
 	std::string s;
-	std::cin >> s;
-	auto res = parseString(s, 0, s.size());
+	std::getline(std::cin, s);
+	auto res = expressionParser().parse(s);
 	res->expand()->print();
 	*/
 	return 0;
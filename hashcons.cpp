@@ -0,0 +1,141 @@
+#include "hashcons.h"
+
+#include "modular.h"
+
+using namespace calc;
+
+namespace
+{
+    thread_local nodeCache *activeCache = nullptr;
+
+    size_t mix(size_t seed, size_t value)
+    {
+        return seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2));
+    }
+}
+
+size_t expressionNode::structuralHash() const
+{
+    if (hashValue)
+        return hashValue;
+    size_t h;
+    if (const polyNode *poly = dynamic_cast<const polyNode *>(this))
+    {
+        h = poly->size();
+        for (size_t i = 0; i < poly->size(); ++i)
+        {
+            h = mix(h, poly->powersAt(i).hash());
+            h = mix(h, (uint64_t(uint32_t(poly->coefAt(i).real())) << 32) | uint32_t(poly->coefAt(i).imag()));
+        }
+    }
+    else
+    {
+        const operationNode *op = static_cast<const operationNode *>(this);
+        h = mix(mix(size_t(op->type()) + 1, op->leftOperand()->structuralHash()), op->rightOperand()->structuralHash());
+    }
+    // 0 marks a hash not computed yet
+    hashValue = h ? h : 1;
+    return hashValue;
+}
+
+const bool expressionNode::equals(const expressionNode *other) const
+{
+    if (this == other)
+        return true;
+    if (structuralHash() != other->structuralHash())
+        return false;
+    const polyNode *polyA = dynamic_cast<const polyNode *>(this);
+    const polyNode *polyB = dynamic_cast<const polyNode *>(other);
+    if (polyA || polyB)
+    {
+        if (!polyA || !polyB || polyA->size() != polyB->size())
+            return false;
+        for (size_t i = 0; i < polyA->size(); ++i)
+            if (polyA->coefAt(i) != polyB->coefAt(i) || !(polyA->powersAt(i) == polyB->powersAt(i)))
+                return false;
+        return true;
+    }
+    const operationNode *opA = static_cast<const operationNode *>(this);
+    const operationNode *opB = static_cast<const operationNode *>(other);
+    return opA->type() == opB->type() && opA->leftOperand()->equals(opB->leftOperand()) &&
+           opA->rightOperand()->equals(opB->rightOperand());
+}
+
+expressionNode *calc::internNode(expressionNode *node)
+{
+    nodeCache *cache = nodeCache::current();
+    return cache ? cache->intern(node) : node;
+}
+
+nodeCache::nodeCache()
+    : memory(arena::current())
+{
+    if (memory)
+        memory->subscribe(*this);
+}
+
+nodeCache::~nodeCache()
+{
+    if (memory)
+        memory->unsubscribe(*this);
+}
+
+void nodeCache::released(arena &)
+{
+    clear();
+}
+
+nodeCache *nodeCache::current()
+{
+    if (!activeCache || arena::current() != activeCache->memory || activeModulus())
+        return nullptr;
+    return activeCache;
+}
+
+expressionNode *nodeCache::intern(expressionNode *node)
+{
+    auto [it, inserted] = nodes.insert(node);
+    if (!inserted)
+        delete node;
+    return *it;
+}
+
+expressionNode *nodeCache::conjugate(const expressionNode *node) const
+{
+    auto it = conjugates.find(node);
+    return it == conjugates.end() ? nullptr : it->second;
+}
+
+expressionNode *nodeCache::expansion(const expressionNode *node) const
+{
+    auto it = expansions.find(node);
+    return it == expansions.end() ? nullptr : it->second;
+}
+
+void nodeCache::rememberConjugate(const expressionNode *node, expressionNode *conjugate)
+{
+    conjugates.emplace(node, conjugate);
+}
+
+void nodeCache::rememberExpansion(const expressionNode *node, expressionNode *expansion)
+{
+    expansions.emplace(node, expansion);
+}
+
+void nodeCache::clear()
+{
+    nodes.clear();
+    conjugates.clear();
+    expansions.clear();
+}
+
+nodeCache::scope::scope(nodeCache &_owner)
+    : previous(activeCache)
+{
+    activeCache = &_owner;
+}
+
+nodeCache::scope::~scope()
+{
+    activeCache = previous;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "calculator.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace calc
+{
+    // hash-consing table of one query: structurally equal nodes made while it is active are created once and shared,
+    // and conj() and expand() are computed once per node
+    // the cache belongs to the arena active when it is constructed and must not outlive it,
+    // it is cleared whenever the arena releases its nodes;
+    // it stays idle while another arena or a modular scope (see modular.h) is active,
+    // as nodes made there would not live long enough or would hold residues
+    class nodeCache : private arena::listener
+    {
+    public:
+        nodeCache();
+        ~nodeCache();
+
+        nodeCache(const nodeCache &) = delete;
+        nodeCache &operator=(const nodeCache &) = delete;
+
+        // cache of the running thread, nullptr if there is none or it is idle
+        static nodeCache *current();
+
+        // the shared node equal to the given one, which is deleted if an equal node already exists
+        expressionNode *intern(expressionNode *node);
+
+        // remembered results, nullptr if unknown
+        expressionNode *conjugate(const expressionNode *node) const;
+        expressionNode *expansion(const expressionNode *node) const;
+        void rememberConjugate(const expressionNode *node, expressionNode *conjugate);
+        void rememberExpansion(const expressionNode *node, expressionNode *expansion);
+
+        size_t size() const { return nodes.size(); }
+        void clear();
+
+        // activates a cache on the running thread for the lifetime of the scope
+        class scope
+        {
+        public:
+            explicit scope(nodeCache &_owner);
+            ~scope();
+
+            scope(const scope &) = delete;
+            scope &operator=(const scope &) = delete;
+
+        private:
+            nodeCache *previous;
+        };
+
+    private:
+        struct hashOf
+        {
+            size_t operator()(const expressionNode *node) const { return node->structuralHash(); }
+        };
+        struct sameAs
+        {
+            bool operator()(const expressionNode *a, const expressionNode *b) const { return a->equals(b); }
+        };
+
+        void released(arena &owner) override;
+
+        arena *memory;
+        std::unordered_set<expressionNode *, hashOf, sameAs> nodes;
+        std::unordered_map<const expressionNode *, expressionNode *> conjugates;
+        std::unordered_map<const expressionNode *, expressionNode *> expansions;
+    };
+}
@@ -0,0 +1,164 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace calc;
+
+namespace
+{
+    const char *const names[size_t(metricKind::COUNT)] = {"expand", "conj", "add", "multiply", "collect", "gcd", "divide"};
+
+    double seconds(uint64_t nanoseconds)
+    {
+        return nanoseconds * 1e-9;
+    }
+
+    // labels of one sample: the operation, if any, followed by the labels of the caller
+    std::string labelsOf(const char *operation, const std::string &labels)
+    {
+        std::string joined;
+        if (operation)
+            joined = std::string("operation=\"") + operation + "\"";
+        if (!labels.empty())
+            joined += (joined.empty() ? "" : ",") + labels;
+        return joined.empty() ? joined : "{" + joined + "}";
+    }
+
+    void family(std::ostream &out, const char *name, const char *type, const char *help)
+    {
+        out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+    }
+}
+
+const char *calc::metricName(metricKind kind)
+{
+    return names[size_t(kind)];
+}
+
+metricsReport &metricsReport::operator+=(const metricsReport &other)
+{
+    for (size_t kind = 0; kind < size_t(metricKind::COUNT); ++kind)
+    {
+        operations[kind].calls += other.operations[kind].calls;
+        operations[kind].nanoseconds += other.operations[kind].nanoseconds;
+        operations[kind].monomials += other.operations[kind].monomials;
+        operations[kind].cancelled += other.operations[kind].cancelled;
+    }
+    nodesAllocated += other.nodesAllocated;
+    comparisons += other.comparisons;
+    maxDepth = std::max(maxDepth, other.maxDepth);
+    largestPolynomial = std::max(largestPolynomial, other.largestPolynomial);
+    return *this;
+}
+
+void metricsReport::print(std::ostream &out) const
+{
+    char row[128];
+    std::snprintf(row, sizeof(row), "%-10s %12s %12s %14s %12s\n", "operation", "calls", "seconds", "monomials", "cancelled");
+    out << row;
+    for (size_t kind = 0; kind < size_t(metricKind::COUNT); ++kind)
+    {
+        const operation &counted = operations[kind];
+        if (!counted.calls)
+            continue;
+        std::snprintf(row, sizeof(row), "%-10s %12llu %12.6f %14llu %12llu\n", names[kind], (unsigned long long)counted.calls,
+                      seconds(counted.nanoseconds), (unsigned long long)counted.monomials, (unsigned long long)counted.cancelled);
+        out << row;
+    }
+    out << "nodes allocated " << nodesAllocated << ", monomial comparisons " << comparisons
+        << ", recursion depth " << maxDepth << ", largest polynomial " << largestPolynomial << '\n';
+}
+
+void metricsReport::printJson(std::ostream &out) const
+{
+    out << "{\"operations\": {";
+    for (size_t kind = 0; kind < size_t(metricKind::COUNT); ++kind)
+    {
+        const operation &counted = operations[kind];
+        out << (kind ? ", " : "") << '"' << names[kind] << "\": {\"calls\": " << counted.calls
+            << ", \"seconds\": " << seconds(counted.nanoseconds) << ", \"monomials\": " << counted.monomials
+            << ", \"cancelled\": " << counted.cancelled << '}';
+    }
+    out << "}, \"nodes_allocated\": " << nodesAllocated << ", \"comparisons\": " << comparisons
+        << ", \"max_depth\": " << maxDepth << ", \"largest_polynomial\": " << largestPolynomial << '}';
+}
+
+void metricsReport::printPrometheus(std::ostream &out, const std::string &labels) const
+{
+    calc::printPrometheus(out, {{labels, *this}});
+}
+
+void calc::printPrometheus(std::ostream &out, const std::vector<std::pair<std::string, metricsReport>> &reports)
+{
+    // every family is written once, with the samples of all reports under it
+    struct series
+    {
+        const char *name, *help;
+        uint64_t metricsReport::operation::*field;
+    };
+    const series perOperation[] = {
+        {"calc_operation_calls_total", "Calls of an instrumented operation.", &metricsReport::operation::calls},
+        {"calc_operation_monomials_total", "Monomials in the results of an operation.", &metricsReport::operation::monomials},
+        {"calc_operation_cancelled_terms_total", "Terms that vanished as like terms were combined.", &metricsReport::operation::cancelled}};
+    for (const series &each : perOperation)
+    {
+        family(out, each.name, "counter", each.help);
+        for (const auto &[labels, report] : reports)
+            for (size_t kind = 0; kind < size_t(metricKind::COUNT); ++kind)
+                out << each.name << labelsOf(names[kind], labels) << ' ' << report.operations[kind].*each.field << '\n';
+    }
+    family(out, "calc_operation_seconds_total", "counter", "Time spent in an operation, including the operations it calls.");
+    for (const auto &[labels, report] : reports)
+        for (size_t kind = 0; kind < size_t(metricKind::COUNT); ++kind)
+            out << "calc_operation_seconds_total" << labelsOf(names[kind], labels) << ' ' << seconds(report.operations[kind].nanoseconds) << '\n';
+
+    struct total
+    {
+        const char *name, *type, *help;
+        uint64_t metricsReport::*field;
+    };
+    const total totals[] = {
+        {"calc_nodes_allocated_total", "counter", "Expression nodes allocated.", &metricsReport::nodesAllocated},
+        {"calc_monomial_comparisons_total", "counter", "Monomial comparisons made while ordering terms.", &metricsReport::comparisons},
+        {"calc_recursion_depth_max", "gauge", "Deepest recursion into an expression tree.", &metricsReport::maxDepth},
+        {"calc_largest_polynomial_monomials", "gauge", "Most monomials in one result.", &metricsReport::largestPolynomial}};
+    for (const total &each : totals)
+    {
+        family(out, each.name, each.type, each.help);
+        for (const auto &[labels, report] : reports)
+            out << each.name << labelsOf(nullptr, labels) << ' ' << report.*each.field << '\n';
+    }
+}
+
+metricsReport metrics::report() const
+{
+    metricsReport result;
+    for (size_t kind = 0; kind < size_t(metricKind::COUNT); ++kind)
+    {
+        result.operations[kind].calls = operations[kind].calls.load(std::memory_order_relaxed);
+        result.operations[kind].nanoseconds = operations[kind].nanoseconds.load(std::memory_order_relaxed);
+        result.operations[kind].monomials = operations[kind].monomials.load(std::memory_order_relaxed);
+        result.operations[kind].cancelled = operations[kind].cancelled.load(std::memory_order_relaxed);
+    }
+    result.nodesAllocated = nodesAllocated.load(std::memory_order_relaxed);
+    result.comparisons = comparisons.load(std::memory_order_relaxed);
+    result.maxDepth = maxDepth.load(std::memory_order_relaxed);
+    result.largestPolynomial = largestPolynomial.load(std::memory_order_relaxed);
+    return result;
+}
+
+void metrics::reset()
+{
+    for (operation &counted : operations)
+    {
+        counted.calls.store(0, std::memory_order_relaxed);
+        counted.nanoseconds.store(0, std::memory_order_relaxed);
+        counted.monomials.store(0, std::memory_order_relaxed);
+        counted.cancelled.store(0, std::memory_order_relaxed);
+    }
+    nodesAllocated.store(0, std::memory_order_relaxed);
+    comparisons.store(0, std::memory_order_relaxed);
+    maxDepth.store(0, std::memory_order_relaxed);
+    largestPolynomial.store(0, std::memory_order_relaxed);
+}
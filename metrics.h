@@ -0,0 +1,237 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// counters and timers on the hot paths of the calculator
+// -DCALC_METRICS=0 compiles them out; otherwise they only run while a metrics scope is active,
+// and cost a thread-local load and a branch per instrumented call when none is
+#ifndef CALC_METRICS
+#define CALC_METRICS 1
+#endif
+
+namespace calc
+{
+    // instrumented operations, times are inclusive: an expansion contains the products it makes
+    enum class metricKind
+    {
+        EXPAND,   // operationNode::expand
+        CONJ,     // polyNode::conj
+        ADD,      // sums of polynomials
+        MULTIPLY, // products of polynomials
+        COLLECT,  // sorting and combining loose monomials
+        GCD,
+        DIVIDE, // exact divisions
+        COUNT
+    };
+
+    const char *metricName(metricKind kind);
+
+    // totals of one query, copied out of the live counters
+    struct metricsReport
+    {
+        struct operation
+        {
+            uint64_t calls = 0;
+            uint64_t nanoseconds = 0;
+            uint64_t monomials = 0; // monomials in the results
+            uint64_t cancelled = 0; // terms that vanished as like terms were combined
+        };
+
+        operation operations[size_t(metricKind::COUNT)];
+        uint64_t nodesAllocated = 0;
+        uint64_t comparisons = 0;       // monomial comparisons made while ordering terms
+        uint64_t maxDepth = 0;          // deepest recursion into an expression tree
+        uint64_t largestPolynomial = 0; // most monomials in one result
+
+        const operation &operator[](metricKind kind) const { return operations[size_t(kind)]; }
+
+        // counts are added, the maxima stay maxima
+        metricsReport &operator+=(const metricsReport &other);
+
+        void print(std::ostream &out) const;
+        void printJson(std::ostream &out) const;
+        // Prometheus text format, labels such as query="pascal" are added to every sample
+        void printPrometheus(std::ostream &out, const std::string &labels = "") const;
+    };
+
+    // several reports in one Prometheus exposition, each with its own labels
+    void printPrometheus(std::ostream &out, const std::vector<std::pair<std::string, metricsReport>> &reports);
+
+    // live counters of a query, shared by every thread working for it
+    class metrics
+    {
+    public:
+        metrics() = default;
+
+        metrics(const metrics &) = delete;
+        metrics &operator=(const metrics &) = delete;
+
+        metricsReport report() const;
+        void reset();
+
+        // metrics collected on the running thread, nullptr if none are
+        static metrics *current() { return active; }
+
+        // collects the metrics of the running thread into owner for the lifetime of the scope
+        class scope
+        {
+        public:
+            explicit scope(metrics &_owner) : previous(active) { active = &_owner; }
+            ~scope() { active = previous; }
+
+            scope(const scope &) = delete;
+            scope &operator=(const scope &) = delete;
+
+        private:
+            metrics *previous;
+        };
+
+        void record(metricKind kind, uint64_t nanoseconds, uint64_t monomials)
+        {
+            operation &counted = operations[size_t(kind)];
+            counted.calls.fetch_add(1, std::memory_order_relaxed);
+            counted.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+            counted.monomials.fetch_add(monomials, std::memory_order_relaxed);
+            raise(largestPolynomial, monomials);
+        }
+        void countCancelled(metricKind kind, uint64_t terms) { operations[size_t(kind)].cancelled.fetch_add(terms, std::memory_order_relaxed); }
+        void countNode() { nodesAllocated.fetch_add(1, std::memory_order_relaxed); }
+        void countComparisons(uint64_t made) { comparisons.fetch_add(made, std::memory_order_relaxed); }
+        void noteDepth(uint64_t depth) { raise(maxDepth, depth); }
+
+    private:
+        struct operation
+        {
+            std::atomic<uint64_t> calls{0}, nanoseconds{0}, monomials{0}, cancelled{0};
+        };
+
+        static void raise(std::atomic<uint64_t> &maximum, uint64_t value)
+        {
+            uint64_t known = maximum.load(std::memory_order_relaxed);
+            while (value > known && !maximum.compare_exchange_weak(known, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        operation operations[size_t(metricKind::COUNT)];
+        std::atomic<uint64_t> nodesAllocated{0}, comparisons{0}, maxDepth{0}, largestPolynomial{0};
+
+        static inline thread_local metrics *active = nullptr;
+    };
+
+    // times one call of an instrumented operation, from construction to destruction
+    // calls nested in a call of the same kind on the same thread are counted but not timed again
+    class metricTimer
+    {
+    public:
+        explicit metricTimer(metricKind _kind) : kind(_kind)
+        {
+            if constexpr (CALC_METRICS)
+                if ((owner = metrics::current()) && nesting[size_t(kind)]++ == 0)
+                    start = std::chrono::steady_clock::now();
+        }
+
+        ~metricTimer()
+        {
+            if constexpr (CALC_METRICS)
+                if (owner)
+                {
+                    uint64_t nanoseconds = 0;
+                    if (--nesting[size_t(kind)] == 0)
+                        nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                    owner->record(kind, nanoseconds, monomials);
+                }
+        }
+
+        metricTimer(const metricTimer &) = delete;
+        metricTimer &operator=(const metricTimer &) = delete;
+
+        // size of the result
+        void produced(size_t _monomials) { monomials = _monomials; }
+
+    private:
+        const metricKind kind;
+        metrics *owner = nullptr;
+        std::chrono::steady_clock::time_point start;
+        size_t monomials = 0;
+
+        static inline thread_local unsigned nesting[size_t(metricKind::COUNT)] = {};
+    };
+
+    // one level of recursion into an expression tree, the depth is counted per thread
+    class metricDepth
+    {
+    public:
+        metricDepth()
+        {
+            if constexpr (CALC_METRICS)
+                if (metrics *owner = metrics::current())
+                {
+                    owner->noteDepth(++depth);
+                    counted = true;
+                }
+        }
+
+        ~metricDepth()
+        {
+            if constexpr (CALC_METRICS)
+                if (counted)
+                    --depth;
+        }
+
+        metricDepth(const metricDepth &) = delete;
+        metricDepth &operator=(const metricDepth &) = delete;
+
+    private:
+        bool counted = false;
+        static inline thread_local uint64_t depth = 0;
+    };
+
+    // comparisons are counted in a local and handed over once
+    class comparisonCount
+    {
+    public:
+        comparisonCount() = default;
+        ~comparisonCount()
+        {
+            if constexpr (CALC_METRICS)
+                if (made)
+                    if (metrics *owner = metrics::current())
+                        owner->countComparisons(made);
+        }
+
+        comparisonCount(const comparisonCount &) = delete;
+        comparisonCount &operator=(const comparisonCount &) = delete;
+
+        void tick()
+        {
+            if constexpr (CALC_METRICS)
+                ++made;
+        }
+
+    private:
+        uint64_t made = 0;
+    };
+
+    inline void countCancelled(metricKind kind, uint64_t terms)
+    {
+        if constexpr (CALC_METRICS)
+            if (terms)
+                if (metrics *owner = metrics::current())
+                    owner->countCancelled(kind, terms);
+    }
+
+    inline void countNode()
+    {
+        if constexpr (CALC_METRICS)
+            if (metrics *owner = metrics::current())
+                owner->countNode();
+    }
+}
@@ -0,0 +1,360 @@
+#include "modular.h"
+
+#include "calculator.h"
+#include "parallel.h"
+
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+using namespace calc;
+
+namespace
+{
+    thread_local uint32_t currentModulus = 0;
+
+    // 128-bit accumulators hold the CRT value of at most this many 31-bit primes
+    constexpr size_t maxLuckyPrimes = 4;
+
+    bool isPrime(uint32_t candidate)
+    {
+        if (candidate < 2 || candidate % 2 == 0)
+            return candidate == 2;
+        for (uint32_t divisor = 3; uint64_t(divisor) * divisor <= candidate; divisor += 2)
+            if (candidate % divisor == 0)
+                return false;
+        return true;
+    }
+
+    bool sameShape(const expressionNode *a, const expressionNode *b)
+    {
+        if (!a || !b)
+            return false;
+        const polyNode *polyA = dynamic_cast<const polyNode *>(a);
+        const polyNode *polyB = dynamic_cast<const polyNode *>(b);
+        if (polyA || polyB)
+        {
+            if (!polyA || !polyB || polyA->size() != polyB->size())
+                return false;
+            for (size_t i = 0; i < polyA->size(); ++i)
+                if (!(polyA->powersAt(i) == polyB->powersAt(i)))
+                    return false;
+            return true;
+        }
+        const operationNode *opA = static_cast<const operationNode *>(a);
+        const operationNode *opB = static_cast<const operationNode *>(b);
+        return opA->type() == opB->type() && sameShape(opA->leftOperand(), opB->leftOperand()) &&
+               sameShape(opA->rightOperand(), opB->rightOperand());
+    }
+
+    __int128 gcdOf(__int128 a, __int128 b)
+    {
+        a = a < 0 ? -a : a;
+        b = b < 0 ? -b : b;
+        while (b)
+        {
+            const __int128 rest = a % b;
+            a = b;
+            b = rest;
+        }
+        return a;
+    }
+
+    // largest r with r * r <= n
+    __int128 squareRoot(__int128 n)
+    {
+        __int128 r = __int128(std::sqrt((long double)n));
+        while (r * r > n)
+            --r;
+        while ((r + 1) * (r + 1) <= n)
+            ++r;
+        return r;
+    }
+
+    // numerator and positive denominator of a rational number
+    struct fraction
+    {
+        __int128 numerator = 0, denominator = 0; // a denominator of 0 marks a failed reconstruction
+
+        bool operator==(const fraction &other) const { return numerator == other.numerator && denominator == other.denominator; }
+    };
+
+    // the fraction n / d with n = d * value modulo the modulus and both below the square root of half of it (Wang)
+    fraction rationalReconstruction(__int128 value, __int128 modulus)
+    {
+        const __int128 bound = squareRoot(modulus / 2);
+        __int128 r0 = modulus, r1 = value < 0 ? value + modulus : value, s0 = 0, s1 = 1;
+        while (r1 > bound)
+        {
+            const __int128 q = r0 / r1, r2 = r0 - q * r1, s2 = s0 - q * s1;
+            r0 = r1;
+            r1 = r2;
+            s0 = s1;
+            s1 = s2;
+        }
+        if (s1 == 0 || (s1 < 0 ? -s1 : s1) > bound || gcdOf(r1, s1) != 1)
+            return {};
+        return s1 < 0 ? fraction{-r1, -s1} : fraction{r1, s1};
+    }
+
+    // images of one expansion modulo several primes, all of the same shape
+    // the images are of the exact form divided by the leading coefficient of its denominator, so their coefficients
+    // are rebuilt as fractions and then brought to a common denominator
+    class reconstruction
+    {
+    public:
+        explicit reconstruction(const std::vector<uint32_t> &_primes)
+            : primes(_primes)
+        {
+        }
+
+        bool stable = true;
+
+        expressionNode *rebuild(const std::vector<const expressionNode *> &images)
+        {
+            gather(images);
+            __int128 scale = 1;
+            for (const fraction &coef : coefficients)
+            {
+                scale = scale / gcdOf(scale, coef.denominator) * coef.denominator;
+                if (scale > INT32_MAX)
+                    throw std::overflow_error("expandMultiModular: coefficient does not fit constTy");
+            }
+            next = 0;
+            return assemble(images, scale);
+        }
+
+    private:
+        // coefficients of every polynomial, real before imaginary parts, in the order assemble() takes them
+        void gather(const std::vector<const expressionNode *> &images)
+        {
+            if (const polyNode *first = dynamic_cast<const polyNode *>(images[0]))
+            {
+                std::vector<constTy> residues(images.size());
+                for (size_t i = 0; i < first->size(); ++i)
+                {
+                    for (size_t k = 0; k < images.size(); ++k)
+                        residues[k] = static_cast<const polyNode *>(images[k])->coefAt(i);
+                    coefficients.push_back(combine(residues, false));
+                    coefficients.push_back(combine(residues, true));
+                }
+                return;
+            }
+            std::vector<const expressionNode *> lefts, rights;
+            for (const expressionNode *image : images)
+            {
+                lefts.push_back(static_cast<const operationNode *>(image)->leftOperand());
+                rights.push_back(static_cast<const operationNode *>(image)->rightOperand());
+            }
+            gather(lefts);
+            gather(rights);
+        }
+
+        expressionNode *assemble(const std::vector<const expressionNode *> &images, __int128 scale)
+        {
+            if (const polyNode *first = dynamic_cast<const polyNode *>(images[0]))
+            {
+                std::vector<monomial> terms;
+                for (size_t i = 0; i < first->size(); ++i)
+                {
+                    const int re = scaled(coefficients[next++], scale), im = scaled(coefficients[next++], scale);
+                    terms.emplace_back(constTy(re, im), first->powersAt(i));
+                }
+                return makeNode<polyNode>(polyNode::collect(std::move(terms)));
+            }
+            const operationNode *op = static_cast<const operationNode *>(images[0]);
+            std::vector<const expressionNode *> lefts, rights;
+            for (const expressionNode *image : images)
+            {
+                lefts.push_back(static_cast<const operationNode *>(image)->leftOperand());
+                rights.push_back(static_cast<const operationNode *>(image)->rightOperand());
+            }
+            expressionNode *left = assemble(lefts, scale);
+            expressionNode *right = assemble(rights, scale);
+            return makeNode<operationNode>(left, right, op->type());
+        }
+
+        static int scaled(const fraction &coef, __int128 scale)
+        {
+            const __int128 value = coef.numerator * (scale / coef.denominator);
+            if (value < INT32_MIN || value > INT32_MAX)
+                throw std::overflow_error("expandMultiModular: coefficient does not fit constTy");
+            return int(value);
+        }
+
+        // Garner's algorithm, then rational reconstruction
+        // stability compares the fractions with and without the last prime, an unstable one is taken as 0
+        fraction combine(const std::vector<constTy> &residues, const bool imaginary)
+        {
+            __int128 value = 0, modulus = 1;
+            fraction previous;
+            for (size_t k = 0; k < primes.size(); ++k)
+            {
+                const uint32_t p = primes[k];
+                if (k)
+                    previous = rationalReconstruction(value, modulus);
+                const int residue = reduceMod(imaginary ? residues[k].imag() : residues[k].real(), p);
+                const uint32_t shift = reduceMod(int64_t(residue) - int64_t(value % p), p);
+                const uint32_t step = uint64_t(shift) * powMod(uint32_t(modulus % p), p - 2, p) % p;
+                value += modulus * step;
+                modulus *= p;
+            }
+            const fraction result = rationalReconstruction(value, modulus);
+            if (!result.denominator || !(result == previous))
+            {
+                stable = false;
+                return {0, 1};
+            }
+            return result;
+        }
+
+        const std::vector<uint32_t> &primes;
+        std::vector<fraction> coefficients;
+        size_t next = 0;
+    };
+}
+
+const std::vector<uint32_t> &calc::modularPrimes()
+{
+    static const std::vector<uint32_t> primes = []
+    {
+        std::vector<uint32_t> found;
+        for (uint32_t candidate = 2147483647u; found.size() < 16; candidate -= 2)
+            if (candidate % 4 == 3 && isPrime(candidate))
+                found.push_back(candidate);
+        return found;
+    }();
+    return primes;
+}
+
+uint32_t calc::activeModulus()
+{
+    return currentModulus;
+}
+
+modularScope::modularScope(uint32_t p)
+    : previous(currentModulus)
+{
+    currentModulus = p;
+}
+
+modularScope::~modularScope()
+{
+    currentModulus = previous;
+}
+
+uint32_t calc::powMod(uint32_t base, uint64_t exponent, uint32_t p)
+{
+    uint64_t result = 1 % p, power = base % p;
+    for (; exponent; exponent >>= 1)
+    {
+        if (exponent & 1)
+            result = result * power % p;
+        power = power * power % p;
+    }
+    return uint32_t(result);
+}
+
+constTy calc::inverseMod(constTy value, uint32_t p)
+{
+    // 1 / (a + bi) = (a - bi) / (a^2 + b^2), the norm is nonzero as -1 is not a square modulo p
+    value = reduceMod(value, p);
+    const uint64_t a = value.real(), b = value.imag();
+    const uint32_t norm = (a * a + b * b) % p;
+    // extended Euclid on the norm, much cheaper than Fermat's p - 2 power
+    int64_t r0 = p, r1 = norm, s0 = 0, s1 = 1;
+    while (r1)
+    {
+        const int64_t q = r0 / r1, r2 = r0 - q * r1, s2 = s0 - q * s1;
+        r0 = r1;
+        r1 = r2;
+        s0 = s1;
+        s1 = s2;
+    }
+    const uint64_t inverseNorm = reduceMod(s0, p);
+    return constTy(int(a * inverseNorm % p), reduceMod(-int64_t(b * inverseNorm % p), p));
+}
+
+constTy calc::powMod(constTy base, int64_t exponent, uint32_t p)
+{
+    if (exponent < 0)
+    {
+        base = inverseMod(base, p);
+        exponent = -exponent;
+    }
+    constTy result = 1;
+    for (base = reduceMod(base, p); exponent; exponent >>= 1)
+    {
+        if (exponent & 1)
+            result = mulMod(result, base, p);
+        base = mulMod(base, base, p);
+    }
+    return result;
+}
+
+expressionNode *calc::expandMultiModular(expressionNode *expression)
+{
+    return expandMultiModular([expression]
+                              { return expression; });
+}
+
+expressionNode *calc::expandMultiModular(const std::function<expressionNode *()> &build)
+{
+    const std::vector<uint32_t> &candidates = modularPrimes();
+    // every image is kept in its own arena until the exact result has been rebuilt
+    std::vector<std::unique_ptr<arena>> memory;
+    std::vector<const expressionNode *> images;
+    size_t used = 0;
+    while (used < candidates.size())
+    {
+        const size_t batch = std::min(candidates.size() - used, std::max<size_t>(used ? 1 : 2, threadCount()));
+        for (size_t i = 0; i < batch; ++i)
+            memory.push_back(std::make_unique<arena>());
+        images.resize(used + batch);
+        parallelFor(batch, [&](size_t i)
+                    {
+                        arena::scope keep(*memory[used + i], false);
+                        modularScope residues(candidates[used + i]);
+                        try
+                        {
+                            images[used + i] = build()->expand();
+                        }
+                        catch (const std::domain_error &)
+                        {
+                            // a denominator vanished modulo this prime
+                            images[used + i] = nullptr;
+                        } });
+        used += batch;
+
+        // the largest group of images sharing a shape decides, the others come from unlucky primes
+        std::vector<size_t> best;
+        for (size_t i = 0; i < used; ++i)
+        {
+            std::vector<size_t> group;
+            for (size_t j = 0; j < used; ++j)
+                if (sameShape(images[i], images[j]))
+                    group.push_back(j);
+            if (group.size() > best.size())
+                best = group;
+        }
+        if (best.size() < 2)
+            continue;
+        if (best.size() > maxLuckyPrimes)
+            best.resize(maxLuckyPrimes);
+        std::vector<uint32_t> primes;
+        std::vector<const expressionNode *> lucky;
+        for (size_t index : best)
+        {
+            primes.push_back(candidates[index]);
+            lucky.push_back(images[index]);
+        }
+        reconstruction exact(primes);
+        expressionNode *result = exact.rebuild(lucky);
+        // the rebuilt fraction is the exact form up to a constant, expanding it again restores the canonical unit
+        if (exact.stable)
+            return result->expand();
+        if (best.size() == maxLuckyPrimes)
+            break;
+    }
+    throw std::overflow_error("expandMultiModular: coefficients did not stabilise");
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace calc
+{
+    using constTy = std::complex<int>;
+
+    class expressionNode;
+
+    // word-sized primes p = 3 (mod 4), largest first
+    // -1 is not a square modulo them, so Z_p[i] is a field and every nonzero Gaussian residue is invertible
+    const std::vector<uint32_t> &modularPrimes();
+
+    // modulus of the coefficient arithmetic on the running thread, 0 while coefficients are exact
+    uint32_t activeModulus();
+
+    // switches polynomial coefficients of the running thread to Z_p[i] for the lifetime of the scope
+    class modularScope
+    {
+    public:
+        explicit modularScope(uint32_t p);
+        ~modularScope();
+
+        modularScope(const modularScope &) = delete;
+        modularScope &operator=(const modularScope &) = delete;
+
+    private:
+        uint32_t previous;
+    };
+
+    inline int reduceMod(int64_t value, uint32_t p)
+    {
+        const int64_t rest = value % p;
+        return int(rest < 0 ? rest + p : rest);
+    }
+
+    inline constTy reduceMod(constTy value, uint32_t p)
+    {
+        return constTy(reduceMod(value.real(), p), reduceMod(value.imag(), p));
+    }
+
+    inline constTy mulMod(constTy a, constTy b, uint32_t p)
+    {
+        a = reduceMod(a, p);
+        b = reduceMod(b, p);
+        const int64_t ar = a.real(), ai = a.imag(), br = b.real(), bi = b.imag();
+        return constTy(reduceMod(ar * br - ai * bi, p), reduceMod(ar * bi + ai * br, p));
+    }
+
+    uint32_t powMod(uint32_t base, uint64_t exponent, uint32_t p);
+    constTy inverseMod(constTy value, uint32_t p); // value must be nonzero modulo p
+    constTy powMod(constTy base, int64_t exponent, uint32_t p); // negative exponents invert the base
+
+    // coefficient arithmetic used by polyNode: exact Gaussian integers, or Z_p[i] inside a modular scope
+    // the modulus is read once per operation, keeping the exact path a plain complex<int> operation
+    struct coefRing
+    {
+        const uint32_t p = activeModulus();
+
+        constTy add(constTy a, constTy b) const
+        {
+            return p ? constTy(reduceMod(int64_t(a.real()) + b.real(), p), reduceMod(int64_t(a.imag()) + b.imag(), p)) : a + b;
+        }
+        constTy mul(constTy a, constTy b) const { return p ? mulMod(a, b, p) : a * b; }
+        bool equal(constTy a, constTy b) const { return p ? reduceMod(a, p) == reduceMod(b, p) : a == b; }
+        bool isZero(constTy a) const { return equal(a, 0); }
+    };
+
+    // expands over Z_p[i] for several primes in parallel and rebuilds the exact coefficients
+    // with the Chinese remainder theorem and rational reconstruction, adding primes until every coefficient is stable
+    // primes whose image has a different shape than the majority are treated as unlucky and dropped
+    // throws std::overflow_error if a coefficient does not fit constTy
+    expressionNode *expandMultiModular(expressionNode *expression);
+
+    // same, but the expression is also constructed once per prime
+    // polynomial products made while building a construction are then reduced as well
+    expressionNode *expandMultiModular(const std::function<expressionNode *()> &build);
+}
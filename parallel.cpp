@@ -0,0 +1,180 @@
+#include "parallel.h"
+
+#include "metrics.h"
+#include "modular.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace calc;
+
+namespace
+{
+    class workerPool
+    {
+    public:
+        workerPool()
+        {
+            unsigned count = std::max(1u, std::thread::hardware_concurrency());
+            if (const char *variable = std::getenv("CALC_THREADS"))
+                count = std::max(1, std::atoi(variable));
+            resize(count);
+        }
+
+        ~workerPool() { stop(); }
+
+        void resize(unsigned count)
+        {
+            stop();
+            size = std::max(1u, count);
+            stopping = false;
+            for (unsigned i = 1; i < size; ++i)
+                workers.emplace_back([this]
+                                     { run(); });
+        }
+
+        unsigned threads() const { return size; }
+
+        void submit(std::function<void()> task)
+        {
+            {
+                std::lock_guard lock(guard);
+                tasks.push_back(std::move(task));
+            }
+            wakeup.notify_one();
+        }
+
+    private:
+        void run()
+        {
+            for (;;)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock lock(guard);
+                    wakeup.wait(lock, [this]
+                                { return stopping || !tasks.empty(); });
+                    if (tasks.empty())
+                        return;
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard lock(guard);
+                stopping = true;
+            }
+            wakeup.notify_all();
+            for (auto &worker : workers)
+                worker.join();
+            workers.clear();
+        }
+
+        unsigned size = 1;
+        bool stopping = false;
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex guard;
+        std::condition_variable wakeup;
+    };
+
+    workerPool &pool()
+    {
+        static workerPool instance;
+        return instance;
+    }
+
+    // iterations are claimed one by one from a shared counter by the caller and by every helper
+    // helpers inherit the coefficient modulus and the metrics of the caller
+    // the first exception thrown by the body is kept for the caller, later iterations are skipped but still counted
+    struct loopState
+    {
+        std::function<void(size_t)> body;
+        size_t count;
+        uint32_t modulus;
+        metrics *counters;
+        std::atomic<size_t> next{0};
+        size_t finished = 0;
+        std::atomic<bool> failed{false};
+        std::exception_ptr failure;
+        std::mutex guard;
+        std::condition_variable done;
+
+        void work()
+        {
+            size_t index;
+            while ((index = next.fetch_add(1)) < count)
+            {
+                if (!failed)
+                    try
+                    {
+                        body(index);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard lock(guard);
+                        if (!failure)
+                            failure = std::current_exception();
+                        failed = true;
+                    }
+                std::lock_guard lock(guard);
+                if (++finished == count)
+                    done.notify_all();
+            }
+        }
+    };
+}
+
+void calc::setThreadCount(unsigned count)
+{
+    pool().resize(count);
+}
+
+unsigned calc::threadCount()
+{
+    return pool().threads();
+}
+
+void calc::parallelFor(size_t count, const std::function<void(size_t)> &body)
+{
+    const size_t helpers = std::min<size_t>(threadCount() - 1, count ? count - 1 : 0);
+    if (helpers == 0)
+    {
+        for (size_t index = 0; index < count; ++index)
+            body(index);
+        return;
+    }
+    auto state = std::make_shared<loopState>();
+    state->body = body;
+    state->count = count;
+    state->modulus = activeModulus();
+    state->counters = metrics::current();
+    for (size_t i = 0; i < helpers; ++i)
+        pool().submit([state]
+                      {
+                          modularScope residues(state->modulus);
+                          if (!state->counters)
+                              return state->work();
+                          metrics::scope counting(*state->counters);
+                          state->work(); });
+    state->work();
+    // the body refers to the frame of the caller, so every helper is done with it before anything is rethrown
+    std::unique_lock lock(state->guard);
+    state->done.wait(lock, [&]
+                     { return state->finished == count; });
+    if (state->failure)
+        std::rethrow_exception(state->failure);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace calc
+{
+    // size of the worker pool used by parallel arithmetic, counting the calling thread
+    // defaults to CALC_THREADS from the environment, or to the number of cores
+    // 1 keeps everything on the calling thread; change it between queries only
+    void setThreadCount(unsigned count);
+    unsigned threadCount();
+
+    // runs body(0) ... body(count - 1) on the pool and on the calling thread, returns once all are done
+    // the caller takes part in the loop, so nested calls from inside a body cannot deadlock
+    // workers run without an active arena: whatever they allocate comes from the heap
+    // the coefficient modulus of the caller (see modular.h) and its metrics (see metrics.h) are passed on to the workers
+    // if the body throws, the remaining iterations are skipped and the first exception is rethrown on the caller
+    // once no helper runs the body any more
+    void parallelFor(size_t count, const std::function<void(size_t)> &body);
+}
@@ -0,0 +1,336 @@
+#include "parser.h"
+
+#include <cctype>
+#include <charconv>
+#include <vector>
+
+using namespace calc;
+
+namespace
+{
+    enum class tokenType
+    {
+        NUMBER,
+        NAME,
+        PLUS,
+        MINUS,
+        STAR,
+        SLASH,
+        CARET,
+        LEFT,
+        RIGHT,
+        COMMA,
+        SEMICOLON,
+        EQUALS,
+        END
+    };
+
+    struct token
+    {
+        tokenType type;
+        std::string_view text;
+        size_t position;
+    };
+
+    // deeper brackets are refused before the recursion runs out of stack
+    constexpr size_t maxNesting = 1000;
+
+    const bool startsName(char c) { return std::isalpha(static_cast<unsigned char>(c)) || c == '_'; }
+    const bool continuesName(char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; }
+    const bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    // hands out the tokens of the text one at a time
+    class tokenizer
+    {
+    public:
+        explicit tokenizer(std::string_view _text) : text(_text) {}
+
+        token next()
+        {
+            while (offset < text.size() && std::isspace(static_cast<unsigned char>(text[offset])))
+                ++offset;
+            const size_t start = offset;
+            if (offset == text.size())
+                return {tokenType::END, text.substr(start, 0), start};
+            const char c = text[offset++];
+            if (isDigit(c))
+            {
+                while (offset < text.size() && isDigit(text[offset]))
+                    ++offset;
+                return {tokenType::NUMBER, text.substr(start, offset - start), start};
+            }
+            if (startsName(c))
+            {
+                while (offset < text.size() && continuesName(text[offset]))
+                    ++offset;
+                return {tokenType::NAME, text.substr(start, offset - start), start};
+            }
+            tokenType type;
+            switch (c)
+            {
+            case '+':
+                type = tokenType::PLUS;
+                break;
+            case '-':
+                type = tokenType::MINUS;
+                break;
+            case '*':
+                type = tokenType::STAR;
+                break;
+            case '/':
+                type = tokenType::SLASH;
+                break;
+            case '^':
+                type = tokenType::CARET;
+                break;
+            case '(':
+                type = tokenType::LEFT;
+                break;
+            case ')':
+                type = tokenType::RIGHT;
+                break;
+            case ',':
+                type = tokenType::COMMA;
+                break;
+            case ';':
+                type = tokenType::SEMICOLON;
+                break;
+            case '=':
+                type = tokenType::EQUALS;
+                break;
+            default:
+                throw parseError(std::string("unexpected character '") + c + "'", start);
+            }
+            return {type, text.substr(start, 1), start};
+        }
+
+    private:
+        std::string_view text;
+        size_t offset = 0;
+    };
+
+    class parsing
+    {
+    public:
+        parsing(std::string_view text, const std::unordered_map<std::string, termKind> &_kinds,
+                const std::unordered_map<std::string, expressionNode *> &_bindings, termKind _undeclared)
+            : tokens(text), kinds(_kinds), bindings(_bindings), undeclared(_undeclared)
+        {
+            advance();
+        }
+
+        expressionParser::equation input(const bool allowEquation)
+        {
+            while (current.type == tokenType::NAME && kindOf(current.text))
+                declaration();
+            expressionParser::equation result = {sum(), nullptr};
+            if (allowEquation && current.type == tokenType::EQUALS)
+            {
+                advance();
+                result.right = sum();
+            }
+            if (current.type != tokenType::END)
+                throw parseError("unexpected '" + std::string(current.text) + "'", current.position);
+            return result;
+        }
+
+    private:
+        tokenizer tokens;
+        token current;
+        const std::unordered_map<std::string, termKind> &kinds;
+        const std::unordered_map<std::string, expressionNode *> &bindings;
+        const termKind undeclared;
+        std::unordered_map<std::string_view, termKind> declared;
+        std::unordered_map<std::string_view, expressionNode *> terms; // every name is interned once per text
+        size_t depth = 0; // brackets open around the current token
+
+        void advance() { current = tokens.next(); }
+
+        static const termKind *kindOf(std::string_view keyword)
+        {
+            static const termKind plain = termKind::PLAIN, real = termKind::REAL, unit = termKind::UNIT;
+            if (keyword == "plain")
+                return &plain;
+            if (keyword == "real")
+                return &real;
+            if (keyword == "unit")
+                return &unit;
+            return nullptr;
+        }
+
+        void declaration()
+        {
+            const termKind kind = *kindOf(current.text);
+            advance();
+            do
+            {
+                if (current.type == tokenType::COMMA)
+                    advance();
+                if (current.type == tokenType::END)
+                    throw parseError("expected ';' ending the declaration", current.position);
+                if (current.type != tokenType::NAME)
+                    throw parseError("expected a term name", current.position);
+                declared[current.text] = kind;
+                advance();
+            } while (current.type != tokenType::SEMICOLON);
+            advance();
+        }
+
+        // summands are added pairwise, so a long flat sum does not re-merge a growing polynomial at every term
+        expressionNode *sum()
+        {
+            std::vector<expressionNode *> summands{product()};
+            while (current.type == tokenType::PLUS || current.type == tokenType::MINUS)
+            {
+                const bool subtract = current.type == tokenType::MINUS;
+                advance();
+                expressionNode *next = product();
+                summands.push_back(subtract ? next->negate() : next);
+            }
+            for (size_t width = 1; width < summands.size(); width *= 2)
+                for (size_t i = 0; i + width < summands.size(); i += 2 * width)
+                    summands[i] = summands[i]->add(summands[i + width]);
+            return summands.front();
+        }
+
+        // left-associative, juxtaposed operands are multiplied
+        expressionNode *product()
+        {
+            expressionNode *left = unary();
+            for (;;)
+            {
+                const tokenType type = current.type;
+                if (type == tokenType::STAR || type == tokenType::SLASH)
+                    advance();
+                else if (type != tokenType::NUMBER && type != tokenType::NAME && type != tokenType::LEFT)
+                    return left;
+                expressionNode *right = unary();
+                left = type == tokenType::SLASH ? left->divide(right) : left->multiply(right);
+            }
+        }
+
+        // leading minuses are counted rather than recursed into, only their parity matters
+        expressionNode *unary()
+        {
+            bool negated = false;
+            for (; current.type == tokenType::MINUS; advance())
+                negated = !negated;
+            expressionNode *result = power();
+            return negated ? result->negate() : result;
+        }
+
+        expressionNode *power()
+        {
+            expressionNode *base = primary();
+            if (current.type != tokenType::CARET)
+                return base;
+            advance();
+            const bool inverse = current.type == tokenType::MINUS;
+            if (inverse)
+                advance();
+            const int exponent = number("an integer exponent");
+            expressionNode *result = power(base, exponent);
+            return inverse ? make_scalar(1)->divide(result) : result;
+        }
+
+        expressionNode *primary()
+        {
+            const token start = current;
+            switch (start.type)
+            {
+            case tokenType::NUMBER:
+                return make_scalar(number("a number"));
+            case tokenType::NAME:
+                advance();
+                if (start.text == "conj" && current.type == tokenType::LEFT)
+                    return bracketed()->conj();
+                return term(start.text);
+            case tokenType::LEFT:
+                return bracketed();
+            case tokenType::END:
+                throw parseError("unexpected end of input", start.position);
+            default:
+                throw parseError("unexpected '" + std::string(start.text) + "'", start.position);
+            }
+        }
+
+        expressionNode *bracketed()
+        {
+            const size_t opening = current.position;
+            if (++depth > maxNesting)
+                throw parseError("brackets nested more than " + std::to_string(maxNesting) + " deep", opening);
+            advance();
+            expressionNode *inside = sum();
+            if (current.type == tokenType::END)
+                throw parseError("unclosed '('", opening);
+            if (current.type != tokenType::RIGHT)
+                throw parseError("expected ')'", current.position);
+            advance();
+            --depth;
+            return inside;
+        }
+
+        int number(const char *what)
+        {
+            if (current.type != tokenType::NUMBER)
+                throw parseError(std::string("expected ") + what, current.position);
+            int value;
+            const char *first = current.text.data(), *last = first + current.text.size();
+            if (std::from_chars(first, last, value).ec != std::errc())
+                throw parseError("number out of range", current.position);
+            advance();
+            return value;
+        }
+
+        expressionNode *term(std::string_view name)
+        {
+            auto found = terms.find(name);
+            if (found != terms.end())
+                return found->second;
+            const std::string spelled(name);
+            auto bound = bindings.find(spelled);
+            if (bound != bindings.end())
+                return terms[name] = bound->second;
+            if (name == "i")
+                return terms[name] = make_scalar(constTy(0, 1));
+            termKind kind = undeclared;
+            auto local = declared.find(name);
+            if (local != declared.end())
+                kind = local->second;
+            else
+            {
+                auto global = kinds.find(spelled);
+                if (global != kinds.end())
+                    kind = global->second;
+            }
+            expressionNode *result = kind == termKind::PLAIN  ? make_term(spelled)
+                                     : kind == termKind::REAL ? make_real_term(spelled)
+                                                              : make_unit_term(spelled);
+            return terms[name] = result;
+        }
+
+        // by squaring
+        static expressionNode *power(expressionNode *base, int exponent)
+        {
+            expressionNode *result = make_scalar(1);
+            for (; exponent; exponent >>= 1)
+            {
+                if (exponent & 1)
+                    result = result->multiply(base);
+                if (exponent > 1)
+                    base = base->multiply(base);
+            }
+            return result;
+        }
+    };
+}
+
+expressionNode *expressionParser::parse(std::string_view text) const
+{
+    return parsing(text, kinds, bindings, undeclared).input(false).left;
+}
+
+expressionParser::equation expressionParser::parseEquation(std::string_view text) const
+{
+    return parsing(text, kinds, bindings, undeclared).input(true);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "calculator.h"
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace calc
+{
+    enum class termKind
+    {
+        PLAIN,
+        REAL,
+        UNIT
+    };
+
+    // malformed input, position is the offset of the offending character
+    class parseError : public std::runtime_error
+    {
+    public:
+        parseError(const std::string &message, size_t _position)
+            : std::runtime_error(message + " at position " + std::to_string(_position)), position(_position)
+        {
+        }
+
+        const size_t position;
+    };
+
+    // one pass over the text with a recursive precedence-climbing parser, no substrings are made
+    // grammar, loosest first:
+    //   input   := { kind name { [","] name } ";" } sum      kind is plain, real or unit
+    //   sum     := product { ("+" | "-") product }
+    //   product := unary { ("*" | "/" | juxtaposition) unary } "2ab" is 2 * ab, "2a b" is 2 * a * b
+    //   unary   := "-" unary | power
+    //   power   := primary [ "^" ["-"] number ]
+    //   primary := number | "i" | name | "conj(" sum ")" | "(" sum ")"
+    // brackets nest at most 1000 deep, a leading run of minuses is folded by its parity
+    // names are letters, digits and underscores starting with a letter or underscore,
+    // plain, real and unit open a declaration at the start of the text;
+    // terms that are not declared get the default kind; i is the imaginary unit unless it is bound to a value
+    class expressionParser
+    {
+    public:
+        explicit expressionParser(termKind _undeclared = termKind::UNIT)
+            : undeclared(_undeclared)
+        {
+        }
+
+        // declarations made here hold for every following parse, declarations in the text for that text only
+        void declare(const std::string &name, termKind kind) { kinds[name] = kind; }
+        // a bound name stands for the given expression instead of a term
+        void bind(const std::string &name, expressionNode *value) { bindings[name] = value; }
+
+        // throws parseError
+        expressionNode *parse(std::string_view text) const;
+
+        // an input optionally followed by "=" sum, right is nullptr without one
+        struct equation
+        {
+            expressionNode *left;
+            expressionNode *right;
+        };
+        equation parseEquation(std::string_view text) const;
+
+    private:
+        termKind undeclared;
+        std::unordered_map<std::string, termKind> kinds;
+        std::unordered_map<std::string, expressionNode *> bindings;
+    };
+}
@@ -0,0 +1,456 @@
+#include "rational.h"
+
+#include "gcd.h"
+#include "hashcons.h"
+#include "modular.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+using namespace calc;
+
+namespace
+{
+    bool isOne(const polyNode &a)
+    {
+        return a.size() == 1 && a.powersAt(0).empty() && a.coefAt(0) == constTy(1);
+    }
+
+    // a divided by one of its known factors
+    polyNode cancel(const polyNode &a, const polyNode &factor)
+    {
+        if (isOne(factor))
+            return a;
+        polyNode quotient;
+        if (!divideExact(a, factor, quotient))
+            throw std::logic_error("rationalFunction: common factor does not divide");
+        return quotient;
+    }
+
+    polyNode shifted(const polyNode &a, const exponentVector &by)
+    {
+        return a * monomial(1, exponentVector() / by);
+    }
+
+    // gcd without its monomial part, which is a unit for Laurent polynomials
+    polyNode commonFactor(const polyNode &a, const polyNode &b)
+    {
+        const polyNode common = gcd(a, b);
+        return shifted(common, monomialContent(common));
+    }
+
+    using memo = std::unordered_map<const expressionNode *, rationalFunction>;
+    using operationType = operationNode::operationType;
+
+    rationalFunction combine(operationType type, const rationalFunction &left, const rationalFunction &right)
+    {
+        switch (type)
+        {
+        case operationType::ADDITION:
+            return left + right;
+        case operationType::MULTIPLICATION:
+            return left * right;
+        default:
+            return left / right;
+        }
+    }
+
+    // operations of an expression large enough to be reduced as tasks of their own, children before parents
+    struct taskGraph
+    {
+        std::unordered_map<const expressionNode *, size_t> index;
+        std::vector<const operationNode *> nodes;
+        std::vector<std::vector<size_t>> parents;
+        std::unique_ptr<std::atomic<unsigned>[]> pending; // children not reduced yet
+        std::vector<std::optional<rationalFunction>> results;
+    };
+
+    // nodes of the graph are looked up there, each one is reduced before a task needing it starts
+    rationalFunction reduce(const expressionNode *expression, memo &done, const nodeCache *cache, const taskGraph *graph = nullptr)
+    {
+        if (graph)
+        {
+            auto task = graph->index.find(expression);
+            if (task != graph->index.end())
+                return *graph->results[task->second];
+        }
+        auto found = done.find(expression);
+        if (found != done.end())
+            return found->second;
+        metricDepth level;
+        rationalFunction result;
+        if (const polyNode *poly = dynamic_cast<const polyNode *>(expression))
+            result = rationalFunction(*poly);
+        else if (const expressionNode *known = cache ? cache->expansion(expression) : nullptr)
+            result = rationalFunction::ofExpansion(known);
+        else
+        {
+            const operationNode *op = static_cast<const operationNode *>(expression);
+            const rationalFunction left = reduce(op->leftOperand(), done, cache, graph);
+            const rationalFunction right = reduce(op->rightOperand(), done, cache, graph);
+            result = combine(op->type(), left, right);
+        }
+        return done[expression] = result;
+    }
+
+    // splits an expression into tasks, subtrees estimated below the cutoff stay inside the task above them
+    class taskBuilder
+    {
+    public:
+        taskBuilder(taskGraph &_graph, const nodeCache *_cache) : graph(_graph), cache(_cache) {}
+
+        // monomial products of reducing a subtree, counted as if no common factor ever cancelled
+        double weight(const expressionNode *node)
+        {
+            return estimate(node).work;
+        }
+
+        // the task reducing a node, none if it is too small or already expanded
+        size_t add(const expressionNode *node)
+        {
+            auto known = graph.index.find(node);
+            if (known != graph.index.end())
+                return known->second;
+            const operationNode *op = dynamic_cast<const operationNode *>(node);
+            if (!op || weight(node) < rationalFunction::parallelExpandThreshold || (cache && cache->expansion(node)))
+                return none;
+            const size_t left = add(op->leftOperand());
+            const size_t right = add(op->rightOperand());
+            const size_t task = graph.nodes.size();
+            graph.index[node] = task;
+            graph.nodes.push_back(op);
+            graph.parents.emplace_back();
+            children.push_back(0);
+            for (const size_t child : {left, right == left ? none : right})
+                if (child != none)
+                {
+                    graph.parents[child].push_back(task);
+                    ++children[task];
+                }
+            return task;
+        }
+
+        void finish()
+        {
+            graph.pending.reset(new std::atomic<unsigned>[graph.nodes.size()]);
+            for (size_t task = 0; task < graph.nodes.size(); ++task)
+                graph.pending[task] = children[task];
+            graph.results.resize(graph.nodes.size());
+        }
+
+        static constexpr size_t none = ~size_t(0);
+
+    private:
+        struct cost
+        {
+            double numerator = 1, denominator = 1; // monomials
+            double work = 0;
+        };
+
+        const cost &estimate(const expressionNode *node)
+        {
+            auto found = costs.find(node);
+            if (found != costs.end())
+                return found->second;
+            cost result;
+            if (const polyNode *poly = dynamic_cast<const polyNode *>(node))
+                result.numerator = std::max<double>(1, poly->size());
+            else if (const expressionNode *known = cache ? cache->expansion(node) : nullptr)
+            {
+                const rationalFunction expanded = rationalFunction::ofExpansion(known);
+                result.numerator = std::max<double>(1, expanded.numerator().size());
+                result.denominator = expanded.denominator().size();
+            }
+            else
+            {
+                const operationNode *op = static_cast<const operationNode *>(node);
+                const cost left = estimate(op->leftOperand()), right = estimate(op->rightOperand());
+                switch (op->type())
+                {
+                case operationType::ADDITION:
+                    result.numerator = left.numerator * right.denominator + right.numerator * left.denominator;
+                    result.denominator = left.denominator * right.denominator;
+                    break;
+                case operationType::MULTIPLICATION:
+                    result.numerator = left.numerator * right.numerator;
+                    result.denominator = left.denominator * right.denominator;
+                    break;
+                case operationType::DIVISION:
+                    result.numerator = left.numerator * right.denominator;
+                    result.denominator = left.denominator * right.numerator;
+                    break;
+                }
+                result.work = left.work + right.work + result.numerator + result.denominator;
+            }
+            return costs[node] = result;
+        }
+
+        taskGraph &graph;
+        const nodeCache *cache;
+        std::unordered_map<const expressionNode *, cost> costs;
+        std::vector<unsigned> children;
+    };
+
+    // tasks become ready on the worker that reduced their last child and are taken newest first,
+    // an idle worker steals the oldest task of another one, or sleeps until a task becomes ready
+    // workers allocate from the heap (see parallel.h), the arena of the caller is only touched by the caller
+    class workStealing
+    {
+    public:
+        workStealing(taskGraph &_graph, const nodeCache *_cache, size_t _workers)
+            : graph(_graph), cache(_cache), workers(_workers), queues(new readyQueue[_workers]), remaining(_graph.nodes.size())
+        {
+            size_t next = 0;
+            for (size_t task = 0; task < graph.nodes.size(); ++task)
+                if (graph.pending[task] == 0)
+                    queues[next++ % workers].tasks.push_back(task);
+            queued = next;
+        }
+
+        void run()
+        {
+            parallelFor(workers, [this](size_t worker)
+                        { work(worker); });
+            if (failure)
+                std::rethrow_exception(failure);
+        }
+
+    private:
+        struct readyQueue
+        {
+            std::mutex guard;
+            std::deque<size_t> tasks;
+        };
+
+        bool take(size_t worker, size_t &task)
+        {
+            for (size_t offset = 0; offset < workers; ++offset)
+            {
+                readyQueue &queue = queues[(worker + offset) % workers];
+                std::lock_guard lock(queue.guard);
+                if (queue.tasks.empty())
+                    continue;
+                if (offset == 0)
+                {
+                    task = queue.tasks.back();
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = queue.tasks.front();
+                    queue.tasks.pop_front();
+                }
+                --queued;
+                return true;
+            }
+            return false;
+        }
+
+        void work(size_t worker)
+        {
+            // small subtrees shared by several tasks of this worker are reduced once
+            memo done;
+            while (remaining && !failed)
+            {
+                size_t task;
+                if (!take(worker, task))
+                {
+                    std::unique_lock lock(idleGuard);
+                    wake.wait(lock, [this]
+                              { return queued || !remaining || failed; });
+                    continue;
+                }
+                try
+                {
+                    const operationNode *op = graph.nodes[task];
+                    const rationalFunction left = reduce(op->leftOperand(), done, cache, &graph);
+                    const rationalFunction right = reduce(op->rightOperand(), done, cache, &graph);
+                    graph.results[task].emplace(combine(op->type(), left, right));
+                }
+                catch (...)
+                {
+                    std::lock_guard lock(failureGuard);
+                    if (!failure)
+                        failure = std::current_exception();
+                    failed = true;
+                    signal(true);
+                    return;
+                }
+                bool pushed = false;
+                for (const size_t parent : graph.parents[task])
+                    if (--graph.pending[parent] == 0)
+                    {
+                        std::lock_guard lock(queues[worker].guard);
+                        queues[worker].tasks.push_back(parent);
+                        ++queued;
+                        pushed = true;
+                    }
+                if (--remaining == 0)
+                    signal(true);
+                else if (pushed)
+                    signal(false);
+            }
+        }
+
+        // the state is changed before the lock is taken, so a worker checking it under the lock cannot miss the wakeup
+        void signal(bool everyone)
+        {
+            {
+                std::lock_guard lock(idleGuard);
+            }
+            if (everyone)
+                wake.notify_all();
+            else
+                wake.notify_one();
+        }
+
+        taskGraph &graph;
+        const nodeCache *cache;
+        const size_t workers;
+        std::unique_ptr<readyQueue[]> queues;
+        std::atomic<size_t> remaining;
+        std::atomic<size_t> queued{0};
+        std::atomic<bool> failed{false};
+        std::mutex idleGuard;
+        std::condition_variable wake;
+        std::exception_ptr failure;
+        std::mutex failureGuard;
+    };
+}
+
+rationalFunction::rationalFunction(const polyNode &_numerator, const polyNode &_denominator)
+{
+    if (_denominator.checkZeroEquality())
+        throw std::domain_error("rationalFunction: zero denominator");
+    // monomial factors of the denominator move to the numerator as negative exponents
+    const exponentVector shift = monomialContent(_denominator);
+    const polyNode upper = shifted(_numerator, shift), lower = shifted(_denominator, shift);
+    const polyNode common = commonFactor(upper, lower);
+    numer = cancel(upper, common);
+    denom = cancel(lower, common);
+    normaliseUnit();
+}
+
+rationalFunction::rationalFunction(const polyNode &_numerator, const polyNode &_denominator, reduced)
+    : numer(_numerator), denom(_denominator)
+{
+    normaliseUnit();
+}
+
+void rationalFunction::normaliseUnit()
+{
+    if (numer.checkZeroEquality())
+    {
+        denom = polyNode(monomial(1, exponentVector()));
+        return;
+    }
+    // every nonzero residue is a unit, the denominator is made monic
+    if (const uint32_t p = activeModulus())
+    {
+        const constTy inverse = inverseMod(denom.coefAt(denom.size() - 1), p);
+        numer = numer * inverse;
+        denom = denom * inverse;
+        return;
+    }
+    const constTy lead = denom.coefAt(denom.size() - 1);
+    const constTy canonical = gcd(lead, constTy(0));
+    for (const constTy unit : {constTy(0, 1), constTy(-1, 0), constTy(0, -1)})
+        if (canonical * unit == lead)
+        {
+            numer = numer * std::conj(unit);
+            denom = denom * std::conj(unit);
+            return;
+        }
+}
+
+const bool rationalFunction::isPolynomial() const
+{
+    return isOne(denom);
+}
+
+rationalFunction rationalFunction::operator+(const rationalFunction &other) const
+{
+    if (isPolynomial() && other.isPolynomial())
+        return rationalFunction(numer + other.numer);
+    // only the common part of the denominators needs to be left out of the cross products
+    const polyNode common = commonFactor(denom, other.denom);
+    const polyNode mine = cancel(denom, common), theirs = cancel(other.denom, common);
+    return rationalFunction(numer * theirs + other.numer * mine, mine * other.denom);
+}
+
+rationalFunction rationalFunction::operator-(const rationalFunction &other) const
+{
+    return *this + rationalFunction(other.numer * constTy(-1), other.denom, reduced());
+}
+
+rationalFunction rationalFunction::operator*(const rationalFunction &other) const
+{
+    if (isPolynomial() && other.isPolynomial())
+        return rationalFunction(numer * other.numer);
+    // both operands are reduced, so only numerators and denominators across them can share factors
+    const polyNode first = commonFactor(numer, other.denom), second = commonFactor(other.numer, denom);
+    return rationalFunction(cancel(numer, first) * cancel(other.numer, second),
+                            cancel(denom, second) * cancel(other.denom, first), reduced());
+}
+
+rationalFunction rationalFunction::operator/(const rationalFunction &other) const
+{
+    if (other.checkZeroEquality())
+        throw std::domain_error("rationalFunction: division by zero");
+    return *this * other.inverse();
+}
+
+rationalFunction rationalFunction::inverse() const
+{
+    const exponentVector shift = monomialContent(numer);
+    return rationalFunction(shifted(denom, shift), shifted(numer, shift), reduced());
+}
+
+expressionNode *rationalFunction::toExpression() const
+{
+    if (isPolynomial())
+        return makeNode<polyNode>(numer);
+    return makeNode<operationNode>(makeNode<polyNode>(numer), makeNode<polyNode>(denom), operationNode::operationType::DIVISION);
+}
+
+rationalFunction rationalFunction::of(const expressionNode *expression)
+{
+    const nodeCache *cache = nodeCache::current();
+    if (threadCount() > 1)
+    {
+        // independent subtrees large enough to pay for a task are reduced on the worker pool
+        taskGraph graph;
+        taskBuilder tasks(graph, cache);
+        tasks.add(expression);
+        if (graph.nodes.size() > 1)
+        {
+            tasks.finish();
+            workStealing(graph, cache, std::min<size_t>(threadCount(), graph.nodes.size())).run();
+            return *graph.results[graph.index.at(expression)];
+        }
+    }
+    memo done;
+    return reduce(expression, done, cache);
+}
+
+rationalFunction rationalFunction::ofExpansion(const expressionNode *expanded)
+{
+    if (const polyNode *poly = dynamic_cast<const polyNode *>(expanded))
+        return rationalFunction(*poly);
+    const operationNode *fraction = static_cast<const operationNode *>(expanded);
+    return ofCoprime(*static_cast<const polyNode *>(fraction->leftOperand()), *static_cast<const polyNode *>(fraction->rightOperand()));
+}
+
+rationalFunction rationalFunction::ofCoprime(const polyNode &numerator, const polyNode &denominator)
+{
+    return rationalFunction(numerator, denominator, reduced());
+}
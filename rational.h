@@ -0,0 +1,65 @@
+#pragma once
+
+#include "calculator.h"
+
+namespace calc
+{
+    // canonical form of an expanded expression: numerator / denominator of coprime polynomials
+    // the numerator is a Laurent polynomial, monomial denominators stay in it as negative exponents;
+    // the denominator is 1 for Laurent polynomials, otherwise a polynomial without monomial factors
+    // whose leading coefficient is the associate with positive real and nonnegative imaginary part,
+    // so equal functions have equal forms
+    // inside a modular scope (see modular.h) common factors are cancelled through their monic image and the denominator
+    // is made monic, so every lucky prime gives the image of the exact form divided by the leading coefficient of its denominator
+    class rationalFunction
+    {
+    public:
+        rationalFunction() : denom(monomial(1, exponentVector())) {}
+        rationalFunction(const polyNode &_numerator)
+            : numer(_numerator), denom(monomial(1, exponentVector()))
+        {
+        }
+        // throws std::domain_error for a zero denominator
+        rationalFunction(const polyNode &_numerator, const polyNode &_denominator);
+
+        rationalFunction operator+(const rationalFunction &other) const;
+        rationalFunction operator-(const rationalFunction &other) const;
+        rationalFunction operator*(const rationalFunction &other) const;
+        rationalFunction operator/(const rationalFunction &other) const;
+
+        const polyNode &numerator() const { return numer; }
+        const polyNode &denominator() const { return denom; }
+
+        const bool checkZeroEquality() const { return numer.checkZeroEquality(); }
+        const bool isPolynomial() const;
+
+        // a polyNode, or a DIVISION of two polyNodes
+        expressionNode *toExpression() const;
+
+        // subtrees estimated below this many monomial products are reduced on one thread
+        static constexpr size_t parallelExpandThreshold = size_t(1) << 12;
+
+        // flat evaluation of an expression tree, shared subtrees are reduced once
+        // subtrees expanded earlier in the query are taken from the node cache (see hashcons.h)
+        // with more than one thread (see parallel.h), independent subtrees above parallelExpandThreshold
+        // are reduced as tasks of a work-stealing scheduler; the result is the same as on one thread
+        static rationalFunction of(const expressionNode *expression);
+        // the form of a result of expand(), taken as it is
+        static rationalFunction ofExpansion(const expressionNode *expanded);
+        // a pair known to be coprime, such as a stored expansion, only the unit is normalised
+        static rationalFunction ofCoprime(const polyNode &numerator, const polyNode &denominator);
+
+    private:
+        polyNode numer;
+        polyNode denom;
+
+        struct reduced
+        {
+        };
+        // takes an already coprime pair, only the unit is normalised
+        rationalFunction(const polyNode &_numerator, const polyNode &_denominator, reduced);
+
+        void normaliseUnit();
+        rationalFunction inverse() const;
+    };
+}
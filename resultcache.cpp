@@ -0,0 +1,232 @@
+#include "resultcache.h"
+
+#include "modular.h"
+
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace calc;
+
+namespace
+{
+    thread_local resultCache *activeCache = nullptr;
+
+    constexpr char magic[8] = {'C', 'A', 'L', 'C', 'R', 'E', 'S', '1'};
+    constexpr uint64_t headerBytes = 16;       // magic, bytes in use
+    constexpr uint64_t recordHeaderBytes = 24; // key, payload size
+    constexpr uint64_t initialBytes = uint64_t(1) << 20;
+
+    uint64_t padded(uint64_t bytes)
+    {
+        return (bytes + 7) & ~uint64_t(7);
+    }
+
+    [[noreturn]] void fail(const std::string &what)
+    {
+        throw std::system_error(errno, std::generic_category(), "resultCache: " + what);
+    }
+
+    // the file lock of other processes, held for the lifetime of the object
+    class fileLock
+    {
+    public:
+        explicit fileLock(int _file) : file(_file)
+        {
+            while (flock(file, LOCK_EX) != 0)
+                if (errno != EINTR)
+                    fail("cannot lock the file");
+        }
+        ~fileLock() { flock(file, LOCK_UN); }
+
+    private:
+        int file;
+    };
+
+    uint64_t fileSize(int file)
+    {
+        struct stat status;
+        if (fstat(file, &status) != 0)
+            fail("cannot read the size of the file");
+        return uint64_t(status.st_size);
+    }
+}
+
+resultCache::resultCache(const std::string &path)
+    : file(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)), scanned(headerBytes)
+{
+    if (file < 0)
+        fail("cannot open " + path);
+    try
+    {
+        fileLock locked(file);
+        uint64_t bytes = fileSize(file);
+        // only an empty file is made a cache, anything else must already be one
+        if (bytes == 0)
+        {
+            if (ftruncate(file, initialBytes) != 0)
+                fail("cannot grow " + path);
+            bytes = initialBytes;
+            map(bytes);
+            std::memcpy(mapped, magic, sizeof(magic));
+            __atomic_store_n(reinterpret_cast<uint64_t *>(mapped + sizeof(magic)), headerBytes, __ATOMIC_RELEASE);
+        }
+        else if (bytes >= headerBytes)
+            map(bytes);
+        if (!mapped || std::memcmp(mapped, magic, sizeof(magic)) != 0)
+            throw std::runtime_error("resultCache: " + path + " is not a result cache");
+        scan();
+    }
+    catch (...)
+    {
+        if (mapped)
+            munmap(mapped, mappedBytes);
+        close(file);
+        throw;
+    }
+}
+
+resultCache::~resultCache()
+{
+    if (activeCache == this)
+        activeCache = nullptr;
+    munmap(mapped, mappedBytes);
+    close(file);
+}
+
+void resultCache::map(uint64_t bytes)
+{
+    if (mapped)
+        munmap(mapped, mappedBytes);
+    void *address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (address == MAP_FAILED)
+    {
+        mapped = nullptr;
+        fail("cannot map the file");
+    }
+    mapped = static_cast<uint8_t *>(address);
+    mappedBytes = bytes;
+}
+
+uint64_t resultCache::used() const
+{
+    return __atomic_load_n(reinterpret_cast<const uint64_t *>(mapped + sizeof(magic)), __ATOMIC_ACQUIRE);
+}
+
+void resultCache::scan()
+{
+    const uint64_t end = used();
+    if (end < headerBytes)
+        throw std::runtime_error("resultCache: the header of the file is corrupt");
+    if (end > mappedBytes)
+    {
+        const uint64_t bytes = fileSize(file);
+        if (end > bytes)
+            throw std::runtime_error("resultCache: the header claims more bytes than the file holds");
+        map(bytes);
+    }
+    // a record cut short or pointing past the end stops the scan, whatever follows it is not trusted
+    while (scanned + recordHeaderBytes <= end)
+    {
+        canonicalKey key;
+        uint64_t size;
+        std::memcpy(&key.high, mapped + scanned, 8);
+        std::memcpy(&key.low, mapped + scanned + 8, 8);
+        std::memcpy(&size, mapped + scanned + 16, 8);
+        const uint64_t payload = scanned + recordHeaderBytes;
+        if (size > end - payload)
+            break;
+        offsets.emplace(key, payload);
+        scanned = payload + padded(size);
+    }
+}
+
+expressionNode *resultCache::find(const canonicalKey &key)
+{
+    auto decode = [&](uint64_t payload) -> expressionNode *
+    {
+        uint64_t size;
+        std::memcpy(&size, mapped + payload - 8, 8);
+        try
+        {
+            return decodeExpansion(mapped + payload, size);
+        }
+        catch (const std::runtime_error &)
+        {
+            return nullptr;
+        }
+    };
+    {
+        std::shared_lock lock(guard);
+        auto found = offsets.find(key);
+        if (found != offsets.end())
+            return decode(found->second);
+        if (used() == scanned)
+            return nullptr;
+    }
+    // another process has appended records since the last scan
+    std::unique_lock lock(guard);
+    scan();
+    auto found = offsets.find(key);
+    return found == offsets.end() ? nullptr : decode(found->second);
+}
+
+void resultCache::store(const canonicalKey &key, const expressionNode *expanded)
+{
+    std::vector<uint8_t> payload;
+    if (!encodeExpansion(expanded, payload))
+        return;
+    std::unique_lock lock(guard);
+    fileLock locked(file);
+    scan();
+    if (offsets.count(key))
+        return;
+    const uint64_t start = used();
+    const uint64_t end = start + recordHeaderBytes + padded(payload.size());
+    if (end > fileSize(file))
+    {
+        if (ftruncate(file, std::max(end, 2 * mappedBytes)) != 0)
+            fail("cannot grow the file");
+    }
+    if (end > mappedBytes)
+        map(fileSize(file));
+    const uint64_t size = payload.size();
+    std::memcpy(mapped + start, &key.high, 8);
+    std::memcpy(mapped + start + 8, &key.low, 8);
+    std::memcpy(mapped + start + 16, &size, 8);
+    std::memcpy(mapped + start + recordHeaderBytes, payload.data(), payload.size());
+    // the record becomes visible to readers only once it is complete
+    __atomic_store_n(reinterpret_cast<uint64_t *>(mapped + sizeof(magic)), end, __ATOMIC_RELEASE);
+    offsets.emplace(key, start + recordHeaderBytes);
+    scanned = end;
+}
+
+size_t resultCache::size() const
+{
+    std::shared_lock lock(guard);
+    return offsets.size();
+}
+
+resultCache *resultCache::current()
+{
+    return activeModulus() ? nullptr : activeCache;
+}
+
+resultCache::scope::scope(resultCache &_owner)
+    : previous(activeCache)
+{
+    activeCache = &_owner;
+}
+
+resultCache::scope::~scope()
+{
+    activeCache = previous;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "encoding.h"
+
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace calc
+{
+    // expansions kept on disk across runs, keyed by the canonical hash of the expanded expression (see encoding.h)
+    // the file is mapped into memory and records are decoded straight from the mapping:
+    //   header: "CALCRES1", bytes in use | records: key, payload size, payload in the format of encoding.h
+    // records are only ever appended; threads of a process share one cache, and appends of several
+    // processes are serialised with a file lock, each one seeing the records of the others on its next miss
+    // while a scope is active, operationNode::expand() looks its results up here and stores new ones
+    class resultCache
+    {
+    public:
+        // opens the file or creates it, throws std::system_error if it cannot
+        // and std::runtime_error if a nonempty file is not a cache; a header claiming more bytes than the file holds
+        // makes this, find() and store() throw std::runtime_error
+        explicit resultCache(const std::string &path);
+        ~resultCache();
+
+        resultCache(const resultCache &) = delete;
+        resultCache &operator=(const resultCache &) = delete;
+
+        // the stored expansion, made in the active arena, nullptr if there is none
+        expressionNode *find(const canonicalKey &key);
+        // keeps an expansion, unless it is known already or cannot be encoded
+        void store(const canonicalKey &key, const expressionNode *expanded);
+
+        size_t size() const;
+
+        // cache of the running thread, nullptr if there is none or a modular scope (see modular.h) is active
+        static resultCache *current();
+
+        // activates a cache on the running thread for the lifetime of the scope
+        class scope
+        {
+        public:
+            explicit scope(resultCache &_owner);
+            ~scope();
+
+            scope(const scope &) = delete;
+            scope &operator=(const scope &) = delete;
+
+        private:
+            resultCache *previous;
+        };
+
+    private:
+        struct keyHash
+        {
+            size_t operator()(const canonicalKey &key) const { return key.low; }
+        };
+
+        void map(uint64_t bytes);
+        void scan(); // indexes records appended since the last scan
+        uint64_t used() const;
+
+        int file;
+        uint8_t *mapped = nullptr;
+        uint64_t mappedBytes = 0;
+        uint64_t scanned;
+        mutable std::shared_mutex guard;
+        std::unordered_map<canonicalKey, uint64_t, keyHash> offsets; // of the payloads
+    };
+}
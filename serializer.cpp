@@ -0,0 +1,337 @@
+#include "serializer.h"
+
+#include <charconv>
+#include <cstring>
+
+using namespace calc;
+
+namespace
+{
+    class plain : public outputFormat
+    {
+    protected:
+        bool coefficient(serializer &out, constTy coef, bool first, bool hasFactors) const override
+        {
+            if (coef.imag() != 0)
+            {
+                if (!first)
+                    out.put(" + ");
+                out.put('(');
+                out.put(coef.real());
+                out.put(" + ");
+                out.put(coef.imag());
+                out.put("i)");
+                return true;
+            }
+            if (coef.real() > 0)
+            {
+                if (!first)
+                    out.put(" + ");
+            }
+            else
+                out.put(first ? "- " : " - ");
+            if (hasFactors && (coef.real() == 1 || coef.real() == -1))
+                return false;
+            out.put(std::abs(coef.real()));
+            return true;
+        }
+
+        void factor(serializer &out, const std::string &name, bool conjugated, int power, bool, bool separate) const override
+        {
+            if (separate)
+                out.put('*');
+            out.put(name);
+            if (conjugated)
+                out.put('$');
+            if (power != 1)
+            {
+                out.put('^');
+                out.put(power);
+            }
+        }
+
+        std::string_view infix(operationNode::operationType type) const override
+        {
+            switch (type)
+            {
+            case operationNode::operationType::ADDITION:
+                return " + ";
+            case operationNode::operationType::DIVISION:
+                return " / ";
+            default:
+                return "";
+            }
+        }
+    };
+
+    class latex : public outputFormat
+    {
+    public:
+        void operation(serializer &out, const operationNode &node) const override
+        {
+            if (node.type() != operationNode::operationType::DIVISION)
+                return outputFormat::operation(out, node);
+            out.put("\\frac{");
+            out << node.leftOperand();
+            out.put("}{");
+            out << node.rightOperand();
+            out.put('}');
+        }
+
+    protected:
+        bool coefficient(serializer &out, constTy coef, bool first, bool hasFactors) const override
+        {
+            if (coef.imag() != 0)
+            {
+                if (!first)
+                    out.put(" + ");
+                out.put('(');
+                if (coef.real() != 0)
+                {
+                    out.put(coef.real());
+                    out.put(coef.imag() > 0 ? '+' : '-');
+                }
+                else if (coef.imag() < 0)
+                    out.put('-');
+                if (std::abs(coef.imag()) != 1)
+                    out.put(std::abs(coef.imag()));
+                out.put("i)");
+                return true;
+            }
+            if (coef.real() > 0)
+            {
+                if (!first)
+                    out.put(" + ");
+            }
+            else
+                out.put(first ? "-" : " - ");
+            if (hasFactors && (coef.real() == 1 || coef.real() == -1))
+                return false;
+            out.put(std::abs(coef.real()));
+            return true;
+        }
+
+        void factor(serializer &out, const std::string &name, bool conjugated, int power, bool, bool separate) const override
+        {
+            if (separate)
+                out.put(" \\cdot ");
+            if (conjugated)
+            {
+                out.put("\\overline{");
+                out.put(name);
+                out.put('}');
+            }
+            else
+                out.put(name);
+            if (power != 1)
+            {
+                out.put("^{");
+                out.put(power);
+                out.put('}');
+            }
+        }
+
+        std::string_view infix(operationNode::operationType type) const override
+        {
+            return type == operationNode::operationType::ADDITION ? " + " : " ";
+        }
+
+        void bracket(serializer &out, bool open) const override
+        {
+            out.put(open ? "\\left(" : "\\right)");
+        }
+    };
+
+    class compact : public outputFormat
+    {
+    protected:
+        bool coefficient(serializer &out, constTy coef, bool first, bool hasFactors) const override
+        {
+            if (coef.imag() != 0)
+            {
+                if (!first)
+                    out.put('+');
+                out.put('(');
+                out.put(coef.real());
+                out.put(',');
+                out.put(coef.imag());
+                out.put(')');
+                return true;
+            }
+            if (coef.real() < 0)
+                out.put('-');
+            else if (!first)
+                out.put('+');
+            if (hasFactors && (coef.real() == 1 || coef.real() == -1))
+                return false;
+            out.put(std::abs(coef.real()));
+            return true;
+        }
+
+        void factor(serializer &out, const std::string &name, bool conjugated, int power, bool first, bool) const override
+        {
+            if (!first)
+                out.put('*');
+            out.put(name);
+            if (conjugated)
+                out.put('$');
+            if (power != 1)
+            {
+                out.put('^');
+                out.put(power);
+            }
+        }
+
+        std::string_view infix(operationNode::operationType type) const override
+        {
+            switch (type)
+            {
+            case operationNode::operationType::ADDITION:
+                return "+";
+            case operationNode::operationType::DIVISION:
+                return "/";
+            default:
+                return "*";
+            }
+        }
+    };
+}
+
+void outputFormat::polynomial(serializer &out, const polyNode &poly) const
+{
+    if (poly.checkZeroEquality())
+        return out.put('0');
+    // one name of several letters and "a b" could be read as the name "ab", so every product is spelled out
+    bool separated = false;
+    for (size_t i = 0; i < poly.size() && !separated; ++i)
+        poly.powersAt(i).forEach([&](unsigned slot, int)
+                                 { separated |= out.symbolAt(slot).name.size() > 1; });
+    for (size_t i = 0; i < poly.size(); ++i)
+    {
+        const exponentVector &product = poly.powersAt(i);
+        bool first = !coefficient(out, poly.coefAt(i), i == 0, !product.empty());
+        bool leading = true;
+        product.forEach([&](unsigned slot, int power)
+                        {
+                            const term &symbol = out.symbolAt(slot);
+                            factor(out, symbol.name, isConjugated(symbol.id), power, first, separated && !leading);
+                            first = leading = false; });
+    }
+}
+
+void outputFormat::operation(serializer &out, const operationNode &node) const
+{
+    // sums need no brackets around their operands, products and fractions bracket sums and fractions
+    const bool sum = node.type() == operationNode::operationType::ADDITION;
+    const bool left = !sum && node.leftOperand()->requiresBracketsPrinting();
+    const bool right = !sum && node.rightOperand()->requiresBracketsPrinting();
+    if (left)
+        bracket(out, true);
+    out << node.leftOperand();
+    if (left)
+        bracket(out, false);
+    out.put(infix(node.type()));
+    if (right)
+        bracket(out, true);
+    out << node.rightOperand();
+    if (right)
+        bracket(out, false);
+}
+
+void outputFormat::bracket(serializer &out, bool open) const
+{
+    out.put(open ? '(' : ')');
+}
+
+const outputFormat &calc::plainFormat()
+{
+    static const plain format;
+    return format;
+}
+
+const outputFormat &calc::latexFormat()
+{
+    static const latex format;
+    return format;
+}
+
+const outputFormat &calc::compactFormat()
+{
+    static const compact format;
+    return format;
+}
+
+serializer::serializer(std::ostream &_stream, const outputFormat &_format)
+    : stream(&_stream), format(_format), storage(streamBufferSize)
+{
+    begin = cursor = storage.data();
+    limit = begin + storage.size();
+}
+
+serializer::serializer(char *_buffer, size_t _capacity, const outputFormat &_format)
+    : format(_format), begin(_buffer), cursor(_buffer), limit(_buffer + _capacity)
+{
+}
+
+serializer::~serializer()
+{
+    flush();
+}
+
+serializer &serializer::operator<<(const expressionNode *node)
+{
+    if (const polyNode *poly = dynamic_cast<const polyNode *>(node))
+        format.polynomial(*this, *poly);
+    else
+        format.operation(*this, *static_cast<const operationNode *>(node));
+    return *this;
+}
+
+void serializer::put(std::string_view text)
+{
+    produced += text.size();
+    // the part that does not fit is written after the buffer has been handed to the stream
+    while (!text.empty())
+    {
+        if (cursor == limit)
+        {
+            overflow();
+            if (cursor == limit)
+                return;
+        }
+        const size_t part = std::min(text.size(), size_t(limit - cursor));
+        std::memcpy(cursor, text.data(), part);
+        cursor += part;
+        text.remove_prefix(part);
+    }
+}
+
+void serializer::put(long long value)
+{
+    char digits[24];
+    const auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+    put(std::string_view(digits, end - digits));
+}
+
+void serializer::flush()
+{
+    if (!stream)
+        return;
+    stream->write(begin, cursor - begin);
+    cursor = begin;
+}
+
+void serializer::overflow()
+{
+    // a caller buffer stays full, the rest is counted only
+    flush();
+}
+
+const term &serializer::symbolAt(unsigned slot)
+{
+    if (slot >= slots.size())
+        slots.resize(slot + 1, nullptr);
+    if (!slots[slot])
+        slots[slot] = symbols().lookup(symbols().symbolAt(slot));
+    return *slots[slot];
+}
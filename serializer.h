@@ -0,0 +1,100 @@
+#pragma once
+
+#include "calculator.h"
+
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace calc
+{
+    class serializer;
+
+    // how expressions are spelled, a new format derives from this and overrides what it spells differently
+    class outputFormat
+    {
+    public:
+        virtual ~outputFormat() {}
+
+        // monomials one after another, 0 for the zero polynomial
+        virtual void polynomial(serializer &out, const polyNode &poly) const;
+        // operands joined by infix(), operands of products and fractions are bracketed when they need it
+        virtual void operation(serializer &out, const operationNode &node) const;
+
+    protected:
+        // sign and coefficient of a monomial, first for the leading one; a coefficient of +-1 may be left out before factors
+        // true if a number was written, the first factor is then not the first thing of the monomial
+        virtual bool coefficient(serializer &out, constTy coef, bool first, bool hasFactors) const = 0;
+        // separate is set between factors of a polynomial that has a name longer than one letter, which juxtaposition would merge
+        virtual void factor(serializer &out, const std::string &name, bool conjugated, int power, bool first, bool separate) const = 0;
+        virtual std::string_view infix(operationNode::operationType type) const = 0;
+        virtual void bracket(serializer &out, bool open) const;
+    };
+
+    // the format of print(): "(1 + 1i)a$^2 - 3b / (c + 1)", "ab + a*b" once a name has several letters
+    const outputFormat &plainFormat();
+    // math mode LaTeX: "(1+i)\overline{a}^{2} - 3b", fractions with \frac, "ab + a \cdot b" once a name has several letters
+    const outputFormat &latexFormat();
+    // one token stream without spaces for other programs: "(1,1)*a$^2-3*b/(c+1)"
+    const outputFormat &compactFormat();
+
+    // writes expressions through a buffer, into a stream or into memory of the caller
+    // monomials are read in place and numbers formatted into the buffer, nothing is copied per term
+    class serializer
+    {
+    public:
+        static constexpr size_t streamBufferSize = 1 << 16;
+
+        // the stream receives the text whenever the buffer fills, on flush() and on destruction
+        explicit serializer(std::ostream &_stream, const outputFormat &_format = plainFormat());
+        // at most capacity characters are stored, without a terminating zero; the rest is only counted
+        serializer(char *_buffer, size_t _capacity, const outputFormat &_format = plainFormat());
+        ~serializer();
+
+        serializer(const serializer &) = delete;
+        serializer &operator=(const serializer &) = delete;
+
+        serializer &operator<<(const expressionNode *node);
+        serializer &operator<<(std::string_view text)
+        {
+            put(text);
+            return *this;
+        }
+        serializer &operator<<(char c)
+        {
+            put(c);
+            return *this;
+        }
+
+        void put(char c)
+        {
+            if (cursor == limit)
+                overflow();
+            if (cursor != limit)
+                *cursor++ = c;
+            ++produced;
+        }
+        void put(std::string_view text);
+        void put(long long value);
+        void put(int value) { put((long long)value); }
+
+        void flush();
+
+        // characters produced so far, including those that did not fit a caller buffer
+        size_t size() const { return produced; }
+        bool truncated() const { return !stream && produced > size_t(limit - begin); }
+
+        // name and conjugation mark of an exponent slot, looked up in the symbol table once per serializer
+        const term &symbolAt(unsigned slot);
+
+    private:
+        void overflow();
+
+        std::ostream *stream = nullptr;
+        const outputFormat &format;
+        std::vector<char> storage; // buffer of a stream serializer
+        char *begin, *cursor, *limit;
+        size_t produced = 0;
+        std::vector<const term *> slots;
+    };
+}
@@ -0,0 +1,299 @@
+#include "straightline.h"
+
+#include "modular.h"
+
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+using namespace calc;
+
+namespace
+{
+    using opcode = straightLineProgram::opcode;
+    using instruction = straightLineProgram::instruction;
+
+    constexpr uint32_t none = UINT32_MAX;
+
+    // emits one instruction per distinct value, the target of a value is its index until registers are assigned
+    class compiler
+    {
+    public:
+        std::vector<instruction> values;
+        std::vector<constTy> constants;
+        std::vector<unsigned> inputs;
+
+        uint32_t node(const expressionNode *expression)
+        {
+            auto found = nodes.find(expression);
+            if (found != nodes.end())
+                return found->second;
+            uint32_t value;
+            if (const polyNode *poly = dynamic_cast<const polyNode *>(expression))
+                value = polynomial(*poly);
+            else
+            {
+                const operationNode *op = static_cast<const operationNode *>(expression);
+                const uint32_t left = node(op->leftOperand()), right = node(op->rightOperand());
+                switch (op->type())
+                {
+                case operationNode::operationType::ADDITION:
+                    value = emit(opcode::ADD, left, right);
+                    break;
+                case operationNode::operationType::MULTIPLICATION:
+                    value = emit(opcode::MUL, left, right);
+                    break;
+                default:
+                    value = emit(opcode::DIV, left, right);
+                    break;
+                }
+            }
+            return nodes[expression] = value;
+        }
+
+    private:
+        std::unordered_map<const expressionNode *, uint32_t> nodes;
+        std::map<std::tuple<opcode, uint32_t, uint32_t>, uint32_t> known;
+        std::map<std::pair<int, int>, uint32_t> constantIndex;
+
+        uint32_t emit(opcode op, uint32_t left, uint32_t right = 0)
+        {
+            if ((op == opcode::ADD || op == opcode::MUL) && right < left)
+                std::swap(left, right);
+            auto [found, added] = known.emplace(std::make_tuple(op, left, right), uint32_t(values.size()));
+            if (added)
+                values.push_back({op, found->second, left, right});
+            return found->second;
+        }
+
+        uint32_t constant(constTy coef)
+        {
+            auto [found, added] = constantIndex.emplace(std::make_pair(coef.real(), coef.imag()), uint32_t(constants.size()));
+            if (added)
+                constants.push_back(coef);
+            return emit(opcode::CONSTANT, found->second);
+        }
+
+        uint32_t slotValue(unsigned slot)
+        {
+            const symbolId id = symbols().symbolAt(slot);
+            if (isQuasi(id))
+                return node(static_cast<quasiTerm *>(symbols().lookup(id))->hidden());
+            if (isConjugated(id))
+                return emit(opcode::CONJ, slotValue(slot - 1));
+            if (std::find(inputs.begin(), inputs.end(), slot) == inputs.end())
+                inputs.push_back(slot);
+            return emit(opcode::LOAD, slot);
+        }
+
+        // x^power by squaring, equal squares are shared through emit()
+        uint32_t power(unsigned slot, int exponent)
+        {
+            if (exponent == 1)
+                return slotValue(slot);
+            const uint32_t half = power(slot, exponent / 2);
+            const uint32_t square = emit(opcode::MUL, half, half);
+            return exponent % 2 ? emit(opcode::MUL, square, slotValue(slot)) : square;
+        }
+
+        // product of the powers of a monomial without its coefficient, none for the empty product
+        // negative exponents are gathered into a single division
+        uint32_t product(const exponentVector &powers)
+        {
+            uint32_t up = none, down = none;
+            powers.forEach([&](unsigned slot, int exponent)
+                           {
+                               uint32_t &side = exponent > 0 ? up : down;
+                               const uint32_t factor = power(slot, std::abs(exponent));
+                               side = side == none ? factor : emit(opcode::MUL, side, factor); });
+            if (down == none)
+                return up;
+            return emit(opcode::DIV, up == none ? constant(1) : up, down);
+        }
+
+        uint32_t polynomial(const polyNode &poly)
+        {
+            uint32_t sum = none;
+            for (size_t i = 0; i < poly.size(); ++i)
+            {
+                const constTy coef = poly.coefAt(i);
+                const uint32_t powers = product(poly.powersAt(i));
+                // unit coefficients fold into the sum as an addition or a subtraction
+                const bool negative = coef == constTy(-1) && powers != none;
+                uint32_t summand;
+                if (powers == none)
+                    summand = constant(coef);
+                else if (coef == constTy(1) || negative)
+                    summand = powers;
+                else
+                    summand = emit(opcode::MUL, constant(coef), powers);
+                if (sum == none)
+                    sum = negative ? emit(opcode::SUB, constant(0), summand) : summand;
+                else
+                    sum = emit(negative ? opcode::SUB : opcode::ADD, sum, summand);
+            }
+            return sum == none ? constant(0) : sum;
+        }
+    };
+
+    const bool readsRegisters(opcode op)
+    {
+        return op != opcode::CONSTANT && op != opcode::LOAD;
+    }
+
+    const bool readsRight(opcode op)
+    {
+        return readsRegisters(op) && op != opcode::CONJ;
+    }
+
+    int addMod(int a, int b, uint32_t p)
+    {
+        const uint32_t sum = uint32_t(a) + uint32_t(b);
+        return int(sum >= p ? sum - p : sum);
+    }
+
+    int subMod(int a, int b, uint32_t p)
+    {
+        return a >= b ? a - b : int(uint32_t(a) + p - uint32_t(b));
+    }
+
+    // mulMod without reducing the operands first
+    constTy mulResidues(constTy a, constTy b, uint32_t p)
+    {
+        const int64_t ar = a.real(), ai = a.imag(), br = b.real(), bi = b.imag();
+        return constTy(reduceMod(ar * br - ai * bi, p), int((ar * bi + ai * br) % p));
+    }
+}
+
+straightLineProgram::straightLineProgram(const expressionNode *expression)
+{
+    compiler lowering;
+    const uint32_t value = lowering.node(expression);
+    program = std::move(lowering.values);
+    constantPool = std::move(lowering.constants);
+    slots = std::move(lowering.inputs);
+    std::sort(slots.begin(), slots.end());
+    inputs = slots.empty() ? 0 : slots.back() + 1;
+    for (const constTy coef : constantPool)
+        constantValues.emplace_back(coef.real(), coef.imag());
+
+    // values are in evaluation order, so a register is free again after the last instruction reading it
+    std::vector<size_t> lastUse(program.size(), 0);
+    for (size_t i = 0; i < program.size(); ++i)
+        if (readsRegisters(program[i].op))
+        {
+            lastUse[program[i].left] = i;
+            if (readsRight(program[i].op))
+                lastUse[program[i].right] = i;
+        }
+    lastUse[value] = program.size();
+    std::vector<uint32_t> assigned(program.size());
+    std::vector<uint32_t> released;
+    for (size_t i = 0; i < program.size(); ++i)
+    {
+        instruction &current = program[i];
+        if (readsRegisters(current.op))
+        {
+            const uint32_t left = current.left, right = current.right;
+            current.left = assigned[left];
+            if (lastUse[left] == i)
+                released.push_back(assigned[left]);
+            if (readsRight(current.op))
+            {
+                current.right = assigned[right];
+                if (lastUse[right] == i && right != left)
+                    released.push_back(assigned[right]);
+            }
+        }
+        if (released.empty())
+            released.push_back(registers++);
+        current.target = assigned[i] = released.back();
+        released.pop_back();
+    }
+    result = assigned[value];
+}
+
+bool straightLineProgram::evaluate(const std::complex<double> *input, std::complex<double> *scratch, std::complex<double> &value) const
+{
+    // written out by hand, std::complex multiplication and division check for infinities on every call
+    for (const instruction &step : program)
+    {
+        std::complex<double> &out = scratch[step.target];
+        switch (step.op)
+        {
+        case opcode::CONSTANT:
+            out = constantValues[step.left];
+            break;
+        case opcode::LOAD:
+            out = input[step.left];
+            break;
+        case opcode::CONJ:
+            out = std::conj(scratch[step.left]);
+            break;
+        case opcode::ADD:
+            out = scratch[step.left] + scratch[step.right];
+            break;
+        case opcode::SUB:
+            out = scratch[step.left] - scratch[step.right];
+            break;
+        case opcode::MUL:
+        {
+            const double ar = scratch[step.left].real(), ai = scratch[step.left].imag();
+            const double br = scratch[step.right].real(), bi = scratch[step.right].imag();
+            out = std::complex<double>(ar * br - ai * bi, ar * bi + ai * br);
+            break;
+        }
+        case opcode::DIV:
+        {
+            const double ar = scratch[step.left].real(), ai = scratch[step.left].imag();
+            const double br = scratch[step.right].real(), bi = scratch[step.right].imag();
+            const double norm = br * br + bi * bi;
+            if (norm == 0)
+                return false;
+            out = std::complex<double>((ar * br + ai * bi) / norm, (ai * br - ar * bi) / norm);
+            break;
+        }
+        }
+    }
+    value = scratch[result];
+    return true;
+}
+
+bool straightLineProgram::evaluate(const constTy *input, uint32_t p, constTy *scratch, constTy &value) const
+{
+    // registers always hold reduced residues
+    for (const instruction &step : program)
+    {
+        constTy &out = scratch[step.target];
+        switch (step.op)
+        {
+        case opcode::CONSTANT:
+            out = reduceMod(constantPool[step.left], p);
+            break;
+        case opcode::LOAD:
+            out = reduceMod(input[step.left], p);
+            break;
+        case opcode::CONJ:
+            out = constTy(scratch[step.left].real(), subMod(0, scratch[step.left].imag(), p));
+            break;
+        case opcode::ADD:
+            out = constTy(addMod(scratch[step.left].real(), scratch[step.right].real(), p),
+                          addMod(scratch[step.left].imag(), scratch[step.right].imag(), p));
+            break;
+        case opcode::SUB:
+            out = constTy(subMod(scratch[step.left].real(), scratch[step.right].real(), p),
+                          subMod(scratch[step.left].imag(), scratch[step.right].imag(), p));
+            break;
+        case opcode::MUL:
+            out = mulResidues(scratch[step.left], scratch[step.right], p);
+            break;
+        case opcode::DIV:
+            if (scratch[step.right] == constTy(0))
+                return false;
+            out = mulResidues(scratch[step.left], inverseMod(scratch[step.right], p), p);
+            break;
+        }
+    }
+    value = scratch[result];
+    return true;
+}
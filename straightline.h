@@ -0,0 +1,63 @@
+#pragma once
+
+#include "calculator.h"
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+namespace calc
+{
+    // an expression lowered to straight-line register code, compiled once and evaluated at many points
+    // shared subexpressions, powers of terms and constants are computed once per evaluation,
+    // and a register is reused as soon as its value is dead
+    // inputs are indexed by exponent slot (see slotOf) and only the slots of basic terms are read:
+    // conjugates of plain terms are computed from the term, conj(u) = 1/u for unit terms,
+    // and quasi terms are replaced by their hidden expression
+    class straightLineProgram
+    {
+    public:
+        enum class opcode : uint8_t
+        {
+            CONSTANT, // left indexes constants()
+            LOAD,     // left is the slot read
+            CONJ,
+            ADD,
+            SUB,
+            MUL,
+            DIV
+        };
+
+        struct instruction
+        {
+            opcode op;
+            uint32_t target;
+            uint32_t left;
+            uint32_t right;
+        };
+
+        explicit straightLineProgram(const expressionNode *expression);
+
+        const std::vector<instruction> &code() const { return program; }
+        const std::vector<constTy> &constants() const { return constantPool; }
+        const std::vector<unsigned> &inputSlots() const { return slots; } // ascending
+        unsigned inputCount() const { return inputs; }                    // highest slot read + 1
+        unsigned registerCount() const { return registers; }
+        uint32_t resultRegister() const { return result; }
+
+        // registers hold registerCount() values of scratch, nothing is allocated
+        // false if a denominator vanishes at the point, value is left unchanged then
+        bool evaluate(const std::complex<double> *input, std::complex<double> *scratch, std::complex<double> &value) const;
+        // over Z_p[i] for a prime p = 3 (mod 4), where conj maps a + bi to a - bi
+        bool evaluate(const constTy *input, uint32_t p, constTy *scratch, constTy &value) const;
+
+    private:
+        std::vector<instruction> program;
+        std::vector<constTy> constantPool;
+        std::vector<std::complex<double>> constantValues;
+        std::vector<unsigned> slots;
+        unsigned inputs = 0;
+        unsigned registers = 0;
+        uint32_t result = 0;
+    };
+}
@@ -0,0 +1,696 @@
+#include "arena.h"
+#include "batch.h"
+#include "calculator.h"
+#include "construction.h"
+#include "encoding.h"
+#include "gcd.h"
+#include "hashcons.h"
+#include "modular.h"
+#include "parallel.h"
+#include "parser.h"
+#include "serializer.h"
+#include "straightline.h"
+#include "zerotest.h"
+
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace calc;
+
+// checks of single parts of the library, every failed check is reported and the exit status is 1
+// g++ -O2 tests.cpp construction.cpp straightline.cpp batch.cpp calculator.cpp arena.cpp exponents.cpp parallel.cpp modular.cpp gcd.cpp rational.cpp hashcons.cpp zerotest.cpp metrics.cpp serializer.cpp encoding.cpp resultcache.cpp parser.cpp -pthread -o tests
+// ./tests
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool condition, const std::string &what)
+	{
+		if (condition)
+			return;
+		std::cerr << "failed: " << what << std::endl;
+		++failures;
+	}
+
+	// exponent slots of basic terms, the conjugate of a plain term takes the slot after it
+	unsigned slotOfTerm(const std::string &name, basicTerm::termProperties props = {false, false})
+	{
+		return slotOf(symbols().intern(name, props));
+	}
+
+	// exponents of the first 40 slots, reaching past the packed lanes and beyond 8 bits
+	exponentVector randomExponents(std::mt19937 &random, std::vector<int> &naive)
+	{
+		naive.assign(40, 0);
+		exponentVector result;
+		for (int factors = 1 + random() % 4; factors > 0; --factors)
+		{
+			const unsigned slot = random() % 40;
+			const int power = random() % 4 == 0 ? 100 + int(random() % 41) : int(random() % 9) - 3;
+			result = result * exponentVector(slot, power);
+			naive[slot] += power;
+		}
+		return result;
+	}
+
+	int naiveCompare(const std::vector<int> &a, const std::vector<int> &b)
+	{
+		int degreeA = 0, degreeB = 0;
+		for (size_t slot = 0; slot < a.size(); ++slot)
+		{
+			degreeA += a[slot];
+			degreeB += b[slot];
+		}
+		if (degreeA != degreeB)
+			return degreeA < degreeB ? -1 : 1;
+		for (size_t slot = 0; slot < a.size(); ++slot)
+			if (a[slot] != b[slot])
+				return a[slot] > b[slot] ? -1 : 1;
+		return 0;
+	}
+
+	void exponentVectorsAcrossWidths()
+	{
+		std::mt19937 random(3);
+		bool agrees = true, roundTrips = true;
+		for (int round = 0; round < 2000; ++round)
+		{
+			std::vector<int> naiveA, naiveB;
+			const exponentVector a = randomExponents(random, naiveA), b = randomExponents(random, naiveB);
+			std::vector<int> naiveProduct(40);
+			bool divides = true;
+			for (unsigned slot = 0; slot < 40; ++slot)
+			{
+				agrees &= a[slot] == naiveA[slot];
+				naiveProduct[slot] = naiveA[slot] + naiveB[slot];
+				divides &= naiveA[slot] >= naiveB[slot];
+			}
+			agrees &= a.compare(b) == naiveCompare(naiveA, naiveB) && b.compare(a) == naiveCompare(naiveB, naiveA);
+			agrees &= a.dividedBy(b) == divides;
+			const exponentVector product = a * b;
+			for (unsigned slot = 0; slot < 40; ++slot)
+				agrees &= product[slot] == naiveProduct[slot];
+			agrees &= product.compare(a) == naiveCompare(naiveProduct, naiveA);
+			// the quotient returns to the form a was built in
+			const exponentVector quotient = product / b;
+			roundTrips &= quotient == a && quotient.isWide() == a.isWide();
+		}
+		check(agrees, "exponent vectors order, divide and multiply like their exponents");
+		check(roundTrips, "exponent vectors return to a single form after leaving the packed one");
+		const exponentVector big = exponentVector(2, 100) * exponentVector(2, 100);
+		check(big.isWide() && big[2] == 200 && !(big / exponentVector(2, 100)).isWide(), "an overflowing byte switches to the wide form and back");
+		check(exponentVector(35, 1).isWide() && exponentVector(3, 1) < exponentVector(35, 1) && exponentVector(3, 1).dividedBy(exponentVector(35, -1)),
+			  "slots past the packed width compare and divide like the others");
+	}
+
+	// terms in random order with repeated powers, over the given slots with exponents from lowest to lowest + 6
+	std::vector<monomial> randomMonomials(std::mt19937 &random, const std::vector<unsigned> &slots, size_t terms, int lowest)
+	{
+		std::vector<monomial> monomials;
+		for (size_t k = 0; k < terms; ++k)
+		{
+			exponentVector powers;
+			for (unsigned slot : slots)
+				powers = powers * exponentVector(slot, lowest + int(random() % 7));
+			monomials.push_back(monomial(constTy(int(random() % 7) - 3, int(random() % 3) - 1), powers));
+		}
+		return monomials;
+	}
+
+	// like terms combined in a std::map, ascending without zero coefficients
+	std::vector<monomial> naiveSum(const std::vector<monomial> &terms)
+	{
+		std::map<exponentVector, constTy> combined;
+		for (const monomial &term : terms)
+			combined[term.product] += term.coef;
+		std::vector<monomial> sum;
+		for (const auto &[powers, coef] : combined)
+			if (coef != constTy(0))
+				sum.push_back(monomial(coef, powers));
+		return sum;
+	}
+
+	// sum of the terms, added pairwise
+	polyNode polynomial(const std::vector<monomial> &terms, size_t first, size_t last)
+	{
+		if (last - first <= 1)
+			return first == last ? polyNode() : polyNode(terms[first]);
+		const size_t middle = first + (last - first) / 2;
+		return polynomial(terms, first, middle) + polynomial(terms, middle, last);
+	}
+
+	polyNode polynomial(const std::vector<monomial> &terms)
+	{
+		return polynomial(terms, 0, terms.size());
+	}
+
+	bool matches(const polyNode &poly, const std::vector<monomial> &terms)
+	{
+		if (poly.size() != terms.size())
+			return false;
+		for (size_t i = 0; i < terms.size(); ++i)
+			if (!(poly.powersAt(i) == terms[i].product) || poly.coefAt(i) != terms[i].coef)
+				return false;
+		return true;
+	}
+
+	void polynomialsStaySorted()
+	{
+		const unsigned a = slotOfTerm("a"), b = slotOfTerm("b");
+		std::mt19937 random(4);
+		bool sorted = true;
+		for (int round = 0; round < 50; ++round)
+		{
+			const std::vector<monomial> f = randomMonomials(random, {a, b}, 1 + random() % 30, -2);
+			const std::vector<monomial> g = randomMonomials(random, {a, b}, 1 + random() % 30, -2);
+			std::vector<monomial> both = f;
+			both.insert(both.end(), g.begin(), g.end());
+			sorted &= matches(polynomial(f), naiveSum(f)) && matches(polynomial(f) + polynomial(g), naiveSum(both));
+			sorted &= (polynomial(f) - polynomial(f)).size() == 0;
+		}
+		check(sorted, "sums store their monomials in ascending order without zero coefficients");
+	}
+
+	std::vector<monomial> schoolbookProduct(const polyNode &f, const polyNode &g)
+	{
+		std::vector<monomial> products;
+		for (size_t i = 0; i < f.size(); ++i)
+			for (size_t j = 0; j < g.size(); ++j)
+				products.push_back(f.at(i) * g.at(j));
+		return naiveSum(products);
+	}
+
+	void johnsonProductMatchesSchoolbook()
+	{
+		const unsigned a = slotOfTerm("a"), b = slotOfTerm("b"), u = slotOfTerm("u", {false, true});
+		const polyNode difference = polynomial({monomial(1, exponentVector(a, 1)), monomial(-1, exponentVector(b, 1))});
+		const polyNode sum = polynomial({monomial(1, exponentVector(a, 1)), monomial(1, exponentVector(b, 1))});
+		const polyNode squares = difference * sum;
+		check(matches(squares, schoolbookProduct(difference, sum)) && squares.size() == 2, "(a - b)(a + b) cancels ab");
+		std::mt19937 random(5);
+		bool agrees = true;
+		for (int round = 0; round < 50; ++round)
+		{
+			const polyNode f = polynomial(randomMonomials(random, {a, b, u}, 1 + random() % 20, -2));
+			const polyNode g = polynomial(randomMonomials(random, {a, b, u}, 1 + random() % 20, -2));
+			agrees &= matches(f * g, schoolbookProduct(f, g));
+			// every product of f (g - g) cancels
+			agrees &= (f * (g - g)).size() == 0 && (f * g - g * f).size() == 0;
+		}
+		check(agrees, "Johnson's product agrees with the schoolbook product on Laurent polynomials");
+		// large enough to split the rows across threads
+		setThreadCount(4);
+		const unsigned c = slotOfTerm("c");
+		const polyNode f = polynomial(randomMonomials(random, {a, b, c, u}, 300, 0)), g = polynomial(randomMonomials(random, {a, b, c, u}, 300, 0));
+		check(f.size() * g.size() >= polyNode::parallelProductThreshold && matches(f * g, schoolbookProduct(f, g)),
+			  "the parallel product agrees with the schoolbook product");
+		setThreadCount(1);
+	}
+
+	void parallelForRethrows()
+	{
+		setThreadCount(4);
+		// once from the caller, which takes index 0 first, and once from whichever thread claims index 37
+		for (size_t thrown : {size_t(0), size_t(37)})
+		{
+			std::atomic<size_t> ran{0};
+			bool caught = false;
+			try
+			{
+				parallelFor(64, [&](size_t index)
+							{
+								++ran;
+								if (index == thrown)
+									throw std::domain_error("index " + std::to_string(index)); });
+			}
+			catch (const std::domain_error &error)
+			{
+				caught = error.what() == "index " + std::to_string(thrown);
+			}
+			check(caught, "parallelFor rethrows the exception of index " + std::to_string(thrown));
+			const size_t settled = ran;
+			check(settled >= 1 && settled <= 64, "parallelFor runs each index at most once");
+			// no helper may still be inside the body after parallelFor has returned
+			std::atomic<size_t> after{0};
+			parallelFor(16, [&](size_t)
+						{ ++after; });
+			check(after == 16 && ran == settled, "the pool keeps working after an exception");
+		}
+		setThreadCount(1);
+		bool caught = false;
+		try
+		{
+			parallelFor(4, [](size_t index)
+						{
+							if (index == 2)
+								throw std::overflow_error("serial"); });
+		}
+		catch (const std::overflow_error &)
+		{
+			caught = true;
+		}
+		check(caught, "parallelFor rethrows on a single thread");
+	}
+
+	void probablyZeroRejectsPoles()
+	{
+		expressionNode *a = make_term("a");
+		bool caught = false;
+		try
+		{
+			probablyZero(make_scalar(1)->divide(a->substract(a)));
+		}
+		catch (const std::domain_error &)
+		{
+			caught = true;
+		}
+		check(caught, "probablyZero throws on a zero denominator");
+	}
+
+	polyNode expanded(expressionNode *expression)
+	{
+		return *static_cast<polyNode *>(expression->expand());
+	}
+
+	// equal up to a unit, each divides the other
+	bool associates(const polyNode &a, const polyNode &b)
+	{
+		polyNode quotient;
+		return divideExact(a, b, quotient) && divideExact(b, a, quotient);
+	}
+
+	void gaussianGcd()
+	{
+		check(gcd(constTy(150000, 100000), constTy(50000, 200000)) == constTy(50000, 0), "gcd of coefficients above 46341");
+		check(gcd(constTy(2147483647, 0), constTy(0, 2147483647)) == constTy(2147483647, 0), "gcd of associates near 2^31");
+		check(gcd(constTy(-2147483647, 2147483647), constTy(2147483646, 0)) == constTy(1, 1), "gcd with norms above 2^63");
+		check(gcd(constTy(3, 2), constTy(0, 0)) == constTy(3, 2) && gcd(constTy(0, 0), constTy(-2, 3)) == constTy(3, 2),
+			  "gcd with zero is the normalised other operand");
+	}
+
+	void polynomialGcd()
+	{
+		expressionNode *a = make_term("a"), *b = make_term("b"), *c = make_term("c");
+		expressionNode *common = a->substract(b->multiply(constTy(2)))->add(c->multiply(constTy(3, 1)));
+		expressionNode *left = a->add(b)->multiply(a->substract(c));
+		expressionNode *right = b->multiply(constTy(5))->add(c->multiply(c));
+		check(associates(gcd(expanded(common->multiply(left)), expanded(common->multiply(right))), expanded(common)),
+			  "gcd of products with a known common factor");
+		check(associates(gcd(expanded(left), expanded(right)), expanded(make_scalar(1))), "gcd of coprime polynomials is a unit");
+		// the leading coefficient 2^31 - 1 vanishes modulo the first prime, which is skipped for the next one
+		expressionNode *x = make_term("x");
+		expressionNode *unlucky = x->multiply(x)->multiply(x)->multiply(constTy(2147483647))->add(make_scalar(1));
+		expressionNode *factor = x->add(make_scalar(1));
+		check(associates(gcd(expanded(unlucky->multiply(factor)), expanded(factor->multiply(x->substract(make_scalar(2))))), expanded(factor)),
+			  "gcd found with the second prime");
+	}
+
+	void probablyZeroRejectsNonzero()
+	{
+		expressionNode *a = make_term("a"), *b = make_term("b");
+		expressionNode *square = a->add(b)->multiply(a->add(b));
+		const zeroTestResult nonzero = probablyZero(square->substract(a->multiply(a))->substract(b->multiply(b)));
+		check(!nonzero.isZero && nonzero.errorProbability == 0, "probablyZero rejects (a + b)^2 - a^2 - b^2");
+		const zeroTestResult zero = probablyZero(square->substract(a->multiply(a))->substract(b->multiply(b))->substract(a->multiply(b)->multiply(constTy(2))));
+		check(zero.isZero && zero.trials >= 2, "probablyZero accepts (a + b)^2 - a^2 - b^2 - 2ab");
+	}
+
+	std::string print(const expressionNode *expression, const outputFormat &format = plainFormat())
+	{
+		std::ostringstream out;
+		serializer(out, format) << expression;
+		return out.str();
+	}
+
+	// sum over k of f^2 (a + (k + i) c) / (f^2 (a - k b + (2k + 1) c)) with f = x a + y b - z c
+	expressionNode *sharedSquare(int x, int y, int z, int terms)
+	{
+		expressionNode *a = make_term("a"), *b = make_term("b"), *c = make_term("c");
+		expressionNode *f = a->multiply(constTy(x))->add(b->multiply(constTy(y)))->substract(c->multiply(constTy(z)));
+		expressionNode *sum = make_scalar(0);
+		for (int k = 1; k <= terms; ++k)
+		{
+			expressionNode *upper = f->multiply(f)->multiply(a->add(c->multiply(constTy(k, 1))));
+			expressionNode *lower = f->multiply(f)->multiply(a->substract(b->multiply(constTy(k)))->add(c->multiply(constTy(2 * k + 1))));
+			sum = sum->add(upper->divide(lower));
+		}
+		return sum;
+	}
+
+	void multiModularCancelsCommonFactors()
+	{
+		for (int terms = 1; terms <= 3; ++terms)
+		{
+			expressionNode *sum = sharedSquare(97, 89, 83, terms);
+			check(print(expandMultiModular(sum)) == print(sum->expand()),
+				  "exact and multi-modular expansion agree on " + std::to_string(terms) + " fractions");
+		}
+		// the lifted gcd is too large for the exact path, the images still cancel it
+		// with f = c the shared square is a monomial, which the exact path cancels directly
+		check(print(expandMultiModular(sharedSquare(997, 991, 983, 2))) == print(sharedSquare(0, 0, -1, 2)->expand()),
+			  "multi-modular expansion cancels a common factor with large coefficients");
+	}
+
+	void nodeCacheSharesEqualNodes()
+	{
+		nodeCache cache;
+		nodeCache::scope sharing(cache);
+		expressionNode *a = make_term("a"), *b = make_term("b");
+		check(make_term("a") == a, "a term is made once");
+		expressionNode *quotient = a->add(b)->divide(a->substract(b));
+		check(a->add(b)->divide(a->substract(b)) == quotient, "structurally equal fractions are the same node");
+		check(b->add(a)->divide(a->substract(b)) == quotient, "sums are shared whatever the order of their operands");
+		check(a->add(b)->divide(b->substract(a)) != quotient, "different fractions are different nodes");
+		check(internNode(new polyNode(*static_cast<polyNode *>(a))) == a, "interning a copy returns the shared node");
+	}
+
+	// random values for the inputs of a program: unit terms on the unit circle, real terms on the real axis
+	void samplePoint(const straightLineProgram &program, std::mt19937 &random, std::vector<std::complex<double>> &point)
+	{
+		std::uniform_real_distribution<double> coordinate(-2, 2);
+		point.resize(std::max<size_t>(point.size(), program.inputCount()));
+		for (unsigned slot : program.inputSlots())
+		{
+			const symbolId id = symbols().symbolAt(slot);
+			if (isUnit(id))
+				point[slot] = std::polar(1.0, coordinate(random));
+			else if (isReal(id))
+				point[slot] = coordinate(random);
+			else
+				point[slot] = {coordinate(random), coordinate(random)};
+		}
+	}
+
+	void sampleResidues(const straightLineProgram &program, std::mt19937 &random, uint32_t p, std::vector<constTy> &point)
+	{
+		point.resize(std::max<size_t>(point.size(), program.inputCount()));
+		for (unsigned slot : program.inputSlots())
+			point[slot] = constTy(1 + random() % (p - 1), isReal(symbols().symbolAt(slot)) ? 0 : random() % p);
+	}
+
+	bool nearlyEqual(std::complex<double> a, std::complex<double> b)
+	{
+		return std::abs(a - b) <= 1e-9 * (1 + std::abs(a));
+	}
+
+	// (a conj(b) + u r) / (a - conj(u)) + conj(a u)^2 r + (2 - 3i) / (b + u) over plain a, b, unit u and real r
+	expressionNode *mixedTerms()
+	{
+		expressionNode *a = make_term("a"), *b = make_term("b"), *u = make_unit_term("u"), *r = make_real_term("r");
+		expressionNode *au = a->multiply(u)->conj();
+		return a->multiply(b->conj())->add(u->multiply(r))->divide(a->substract(u->conj()))->add(au->multiply(au)->multiply(r))->add(make_scalar(constTy(2, -3))->divide(b->add(u)));
+	}
+
+	void straightLineMatchesExpansion()
+	{
+		expressionNode *expression = mixedTerms();
+		const straightLineProgram direct(expression), expanded(expression->expand());
+		std::vector<std::complex<double>> point, directScratch(direct.registerCount()), expandedScratch(expanded.registerCount());
+		std::vector<constTy> residues, directResidues(direct.registerCount()), expandedResidues(expanded.registerCount());
+		const uint32_t p = 1000003; // 3 (mod 4)
+		std::mt19937 random(14);
+		bool agrees = true, agreesModulo = true;
+		for (int round = 0; round < 100; ++round)
+		{
+			samplePoint(direct, random, point);
+			samplePoint(expanded, random, point);
+			std::complex<double> directValue, expandedValue;
+			agrees &= direct.evaluate(point.data(), directScratch.data(), directValue) &&
+					  expanded.evaluate(point.data(), expandedScratch.data(), expandedValue) && nearlyEqual(directValue, expandedValue);
+			sampleResidues(direct, random, p, residues);
+			sampleResidues(expanded, random, p, residues);
+			constTy directResidue, expandedResidue;
+			const bool directDefined = direct.evaluate(residues.data(), p, directResidues.data(), directResidue);
+			const bool expandedDefined = expanded.evaluate(residues.data(), p, expandedResidues.data(), expandedResidue);
+			// a point may be a pole of the expansion only, where a removable one cancelled
+			agreesModulo &= !directDefined || !expandedDefined || directResidue == expandedResidue;
+		}
+		check(agrees, "an expression and its expansion agree at random complex points");
+		check(agreesModulo, "an expression and its expansion agree at random points of Z_p[i]");
+
+		// the pole a = b of 1 / (a - b)
+		expressionNode *a = make_term("a"), *b = make_term("b");
+		const straightLineProgram pole(make_scalar(1)->divide(a->substract(b)));
+		std::vector<std::complex<double>> at(pole.inputCount(), std::complex<double>(0.5, -1)), scratch(pole.registerCount());
+		std::complex<double> value(42, 7);
+		check(!pole.evaluate(at.data(), scratch.data(), value) && value == std::complex<double>(42, 7), "a complex pole leaves the value unchanged");
+		std::vector<constTy> atResidue(pole.inputCount(), constTy(5, 11)), residueScratch(pole.registerCount());
+		constTy residue(42, 7);
+		check(!pole.evaluate(atResidue.data(), p, residueScratch.data(), residue) && residue == constTy(42, 7), "a pole in Z_p[i] leaves the value unchanged");
+
+		// conj(u) = 1/u for a unit term, it needs no CONJ instruction
+		expressionNode *u = make_unit_term("u");
+		const straightLineProgram inverse(u->conj());
+		bool conjugates = true;
+		for (const straightLineProgram::instruction &step : inverse.code())
+			conjugates &= step.op != straightLineProgram::opcode::CONJ;
+		std::vector<std::complex<double>> onCircle(inverse.inputCount()), inverseScratch(inverse.registerCount());
+		onCircle[slotOfTerm("u", {false, true})] = std::polar(1.0, 0.7);
+		std::complex<double> conjugate;
+		conjugates &= inverse.evaluate(onCircle.data(), inverseScratch.data(), conjugate) && nearlyEqual(conjugate, std::polar(1.0, -0.7));
+		std::vector<constTy> unitResidue(inverse.inputCount(), constTy(3, 4)), unitScratch(inverse.registerCount());
+		constTy inverted;
+		conjugates &= inverse.evaluate(unitResidue.data(), p, unitScratch.data(), inverted) && mulMod(inverted, constTy(3, 4), p) == constTy(1);
+		check(conjugates, "the conjugate of a unit term is its inverse");
+	}
+
+	void batchMatchesStraightLine()
+	{
+		expressionNode *a = make_term("a"), *b = make_term("b"), *r = make_real_term("r");
+		const straightLineProgram program(mixedTerms()->add(r->divide(a->substract(b))));
+		const size_t count = 67; // a block and a part of one
+		std::mt19937 random(15);
+		std::vector<std::vector<std::complex<double>>> points(count);
+		for (std::vector<std::complex<double>> &point : points)
+			samplePoint(program, random, point);
+		const unsigned slotA = slotOfTerm("a"), slotB = slotOfTerm("b"), slotU = slotOfTerm("u", {false, true});
+		// a = b and b = -u are singular
+		for (size_t singularPoint : {3, 64, 66})
+			points[singularPoint][slotA] = points[singularPoint][slotB];
+		points[65][slotB] = -points[65][slotU];
+		std::vector<std::vector<double>> re(program.inputCount(), std::vector<double>(count)), im = re;
+		std::vector<complexPlanes> inputs(program.inputCount());
+		for (unsigned slot : program.inputSlots())
+		{
+			for (size_t k = 0; k < count; ++k)
+			{
+				re[slot][k] = points[k][slot].real();
+				im[slot][k] = points[k][slot].imag();
+			}
+			inputs[slot] = {re[slot].data(), im[slot].data()};
+		}
+		std::vector<double> outRe(count), outIm(count);
+		std::vector<uint8_t> singular(count);
+		batchEvaluator batch(program);
+		const size_t singularCount = batch.evaluate(inputs.data(), count, outRe.data(), outIm.data(), singular.data());
+		std::vector<std::complex<double>> scratch(program.registerCount());
+		bool agrees = true;
+		size_t poles = 0;
+		for (size_t k = 0; k < count; ++k)
+		{
+			std::complex<double> value;
+			const bool defined = program.evaluate(points[k].data(), scratch.data(), value);
+			poles += !defined;
+			agrees &= bool(singular[k]) == !defined;
+			agrees &= defined ? nearlyEqual(value, {outRe[k], outIm[k]}) : std::isnan(outRe[k]) && std::isnan(outIm[k]);
+		}
+		check(agrees, "batch evaluation agrees with the straight-line program point by point");
+		check(poles == 4 && singularCount == poles, "batch evaluation counts the singular points");
+	}
+
+	void parserLimitsNesting()
+	{
+		const expressionParser parser;
+		size_t position = 0;
+		try
+		{
+			parser.parse(std::string(20000, '(') + "a" + std::string(20000, ')'));
+		}
+		catch (const parseError &error)
+		{
+			position = error.position;
+		}
+		check(position == 1000, "brackets nested too deeply are refused at the first one too many");
+		check(print(parser.parse(std::string(200001, '-') + "a")->expand()) == print(parser.parse("-a")->expand()), "a long run of minuses is folded by its parity");
+		check(print(parser.parse("(((a + b)))")) == "a + b", "brackets within the limit parse");
+	}
+
+	void parserKnowsTheImaginaryUnit()
+	{
+		expressionParser parser;
+		check(parser.parse("i*i + 1")->expand()->checkZeroEquality(), "i*i = -1");
+		check(print(parser.parse("(1 + i) a")->expand()) == print(make_term("a")->multiply(constTy(1, 1))), "i is a coefficient");
+		parser.bind("i", make_term("x"));
+		check(print(parser.parse("i")) == "x", "a binding of i takes precedence");
+	}
+
+	void quasiSlotsAreReused()
+	{
+		arena inner;
+		symbolId retired, partner;
+		{
+			arena::scope query(inner, false);
+			nodeCache cache;
+			nodeCache::scope sharing(cache);
+			retired = symbols().intern("q", make_term("a")->add(make_term("b")));
+			partner = symbols().conjugate(retired);
+			check(cache.size() > 0, "the cache holds the hidden expression");
+			inner.release();
+			check(cache.size() == 0, "releasing the arena empties its cache");
+		}
+		bool thrown = false;
+		try
+		{
+			symbols().lookup(retired);
+		}
+		catch (const std::logic_error &)
+		{
+			thrown = true;
+		}
+		check(thrown, "looking up a retired quasi term throws");
+		const symbolId reused = symbols().intern("r", make_term("c")->multiply(make_term("d")));
+		check(slotOf(reused) == slotOf(retired) && slotOf(symbols().conjugate(reused)) == slotOf(partner),
+			  "the next quasi term takes the slots of the retired one");
+		check(symbols().name(reused) == "r", "the reused slot names the new term");
+	}
+
+	void serializerSeparatesLongNames()
+	{
+		expressionNode *a = make_term("a"), *b = make_term("b"), *ab = make_term("ab");
+		expressionNode *both = ab->add(a->multiply(b))->expand();
+		check(print(both) == "ab + a*b", "plain format separates the factors next to a longer name");
+		check(print(both, latexFormat()) == "ab + a \\cdot b", "LaTeX format separates the factors next to a longer name");
+		check(print(a->multiply(b)->expand()) == "ab", "single letters stay juxtaposed");
+	}
+
+	void encodingRoundTrips()
+	{
+		expressionNode *a = make_term("a"), *b = make_term("b"), *u = make_unit_term("u"), *r = make_real_term("r");
+		// conjugated, real and unit terms, a Laurent polynomial and a fraction
+		expressionNode *expansions[] = {
+			a->multiply(a->conj())->add(r->multiply(u->conj()))->add(make_scalar(constTy(0, 5))->multiply(u))->expand(),
+			u->add(u->conj())->multiply(r)->multiply(constTy(-300, 7))->expand(),
+			a->multiply(a->conj())->add(r->multiply(u->conj()))->divide(a->add(b->multiply(constTy(3))))->expand(),
+			make_scalar(0)->expand(),
+		};
+		for (expressionNode *expansion : expansions)
+		{
+			std::vector<uint8_t> data;
+			check(encodeExpansion(expansion, data), "encoded " + print(expansion));
+			expressionNode *decoded = decodeExpansion(data.data(), data.size());
+			check(print(decoded) == print(expansion) && canonicalHash(decoded) == canonicalHash(expansion), "decoded " + print(expansion));
+		}
+
+		// the same expression over terms interned in the opposite order, in another process
+		auto build = []()
+		{
+			expressionNode *first = make_unit_term("first"), *second = make_term("second");
+			return first->add(second->multiply(second)->multiply(constTy(2)))->add(first->multiply(second->conj())->multiply(constTy(0, 1)))->divide(second->add(make_scalar(1)))->expand();
+		};
+		int channel[2];
+		check(pipe(channel) == 0, "pipe");
+		const pid_t child = fork();
+		if (child == 0)
+		{
+			close(channel[0]);
+			make_term("second");
+			expressionNode *expression = build();
+			const canonicalKey key = canonicalHash(expression);
+			std::vector<uint8_t> data;
+			encodeExpansion(expression, data);
+			const bool written = write(channel[1], &key, sizeof(key)) == sizeof(key) && write(channel[1], data.data(), data.size()) == ssize_t(data.size());
+			_exit(written ? 0 : 1);
+		}
+		close(channel[1]);
+		std::vector<uint8_t> received;
+		uint8_t buffer[4096];
+		for (ssize_t got; (got = read(channel[0], buffer, sizeof(buffer))) > 0;)
+			received.insert(received.end(), buffer, buffer + got);
+		close(channel[0]);
+		int status = 1;
+		waitpid(child, &status, 0);
+		check(child > 0 && status == 0 && received.size() > sizeof(canonicalKey), "the other process encoded its expression");
+		if (received.size() <= sizeof(canonicalKey))
+			return;
+		expressionNode *expression = build();
+		check(slotOfTerm("first", {false, true}) < slotOfTerm("second"), "the terms are interned in order here");
+		canonicalKey key;
+		std::memcpy(&key, received.data(), sizeof(key));
+		check(key == canonicalHash(expression), "canonicalHash does not depend on the order of interning");
+		check(print(decodeExpansion(received.data() + sizeof(key), received.size() - sizeof(key))) == print(expression),
+			  "an expansion decodes in a process with other slots");
+	}
+
+	void slicedZeroMatchesExpansion()
+	{
+		expr a = make_unit_term("a"), b = make_unit_term("b"), c = make_unit_term("c"), d = make_unit_term("d");
+		expr e = make_unit_term("e"), f = make_unit_term("f");
+		const expr determinants[] = {
+			collinearity(a, b, c),
+			collinearity(a, b, intersect(chord(a, c), chord(b, d))),
+			collinearity(a, b, middlepoint(a, b)),
+			// Pascal's theorem
+			collinearity(intersect(chord(a, e), chord(b, f)), intersect(chord(c, e), chord(b, d)), intersect(chord(c, f), chord(a, d))),
+		};
+		for (size_t k = 0; k < std::size(determinants); ++k)
+			check(slicedZero(determinants[k]).isZero == determinants[k]->expand()->checkZeroEquality(),
+				  "slicedZero agrees with the expansion of determinant " + std::to_string(k));
+		check(!slicedZero(determinants[1]).isZero && slicedZero(determinants[3]).isZero, "slicedZero decides both ways");
+	}
+}
+
+int main()
+{
+	const std::pair<const char *, void (*)()> tests[] = {
+		{"exponentVectorsAcrossWidths", exponentVectorsAcrossWidths},
+		{"polynomialsStaySorted", polynomialsStaySorted},
+		{"johnsonProductMatchesSchoolbook", johnsonProductMatchesSchoolbook},
+		{"parallelForRethrows", parallelForRethrows},
+		{"probablyZeroRejectsPoles", probablyZeroRejectsPoles},
+		{"gaussianGcd", gaussianGcd},
+		{"polynomialGcd", polynomialGcd},
+		{"probablyZeroRejectsNonzero", probablyZeroRejectsNonzero},
+		{"multiModularCancelsCommonFactors", multiModularCancelsCommonFactors},
+		{"nodeCacheSharesEqualNodes", nodeCacheSharesEqualNodes},
+		{"straightLineMatchesExpansion", straightLineMatchesExpansion},
+		{"batchMatchesStraightLine", batchMatchesStraightLine},
+		{"parserLimitsNesting", parserLimitsNesting},
+		{"parserKnowsTheImaginaryUnit", parserKnowsTheImaginaryUnit},
+		{"quasiSlotsAreReused", quasiSlotsAreReused},
+		{"serializerSeparatesLongNames", serializerSeparatesLongNames},
+		{"encodingRoundTrips", encodingRoundTrips},
+		{"slicedZeroMatchesExpansion", slicedZeroMatchesExpansion},
+	};
+	for (const auto &[name, run] : tests)
+	{
+		const int before = failures;
+		{
+			arena memory;
+			arena::scope query(memory);
+			try
+			{
+				run();
+			}
+			catch (const std::exception &error)
+			{
+				check(false, std::string(name) + " threw " + error.what());
+			}
+		}
+		std::cout << name << (failures == before ? ": ok" : ": FAILED") << std::endl;
+	}
+	return failures ? 1 : 0;
+}
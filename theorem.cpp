@@ -0,0 +1,333 @@
+#include "theorem.h"
+
+#include "arena.h"
+#include "construction.h"
+#include "hashcons.h"
+#include "parallel.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+
+using namespace calc;
+
+namespace
+{
+    std::string_view trim(std::string_view text)
+    {
+        const size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos)
+            return {};
+        return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+    }
+
+    const bool isNameChar(char c)
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    // a point or a line
+    struct value
+    {
+        expr point = nullptr;
+        line straight = {};
+        bool isLine = false;
+    };
+
+    // statements of one script, a failure is reported with its line number
+    class interpreter
+    {
+    public:
+        explicit interpreter(const theoremOptions &_options) : options(_options)
+        {
+            known.insert("i");
+        }
+
+        bool holds = true;
+        size_t checks = 0;
+
+        void statement(std::string_view text, size_t number)
+        {
+            lineNumber = number;
+            text = trim(text.substr(0, text.find('#')));
+            if (text.empty())
+                return;
+            const size_t nameEnd = std::find_if_not(text.begin(), text.end(), isNameChar) - text.begin();
+            const std::string_view head = text.substr(0, nameEnd);
+            if (head == "unit" || head == "real" || head == "plain")
+                return declare(head, text.substr(nameEnd));
+            const std::string_view rest = trim(text.substr(nameEnd));
+            if (!head.empty() && !rest.empty() && rest.front() == '=')
+                return assign(std::string(head), evaluate(rest.substr(1)));
+            if (head == "collinear" || head == "concurrent" || head == "equal")
+                return check(text);
+            fail("expected a declaration, an assignment or a check");
+        }
+
+    private:
+        const theoremOptions &options;
+        expressionParser parser;
+        std::map<std::string, line, std::less<>> lines;
+        std::set<std::string, std::less<>> known; // declared terms, points and lines
+        size_t lineNumber = 0;
+
+        [[noreturn]] void fail(const std::string &message) const
+        {
+            throw std::runtime_error("line " + std::to_string(lineNumber) + ": " + message);
+        }
+
+        void declare(std::string_view kind, std::string_view names)
+        {
+            const termKind declared = kind == "unit" ? termKind::UNIT : kind == "real" ? termKind::REAL
+                                                                                       : termKind::PLAIN;
+            size_t start = 0;
+            while ((start = names.find_first_not_of(" \t,", start)) != std::string_view::npos)
+            {
+                const size_t end = std::min(names.find_first_of(" \t,", start), names.size());
+                const std::string name(names.substr(start, end - start));
+                parser.declare(name, declared);
+                known.insert(name);
+                start = end;
+            }
+        }
+
+        void assign(const std::string &name, const value &assigned)
+        {
+            known.insert(name);
+            if (assigned.isLine)
+                lines[name] = assigned.straight;
+            else
+            {
+                lines.erase(name);
+                parser.bind(name, assigned.point);
+            }
+        }
+
+        void check(std::string_view text)
+        {
+            std::string_view name;
+            const std::vector<value> arguments = call(text, name);
+            const size_t expected = name == "equal" ? 2 : 3;
+            if (arguments.size() != expected)
+                fail(std::string(name) + " takes " + std::to_string(expected) + " arguments");
+            expr determinant;
+            if (name == "collinear")
+                determinant = collinearity(point(arguments[0]), point(arguments[1]), point(arguments[2]));
+            else if (name == "equal")
+                determinant = point(arguments[0])->substract(point(arguments[1]));
+            else
+                determinant = concurrence(straight(arguments[0]), straight(arguments[1]), straight(arguments[2]));
+            holds &= vanishes(determinant);
+            ++checks;
+        }
+
+        bool vanishes(expr determinant) const
+        {
+            return options.fastChecks ? probablyZero(determinant, options.fastCheckOptions).isZero
+                                      : slicedZero(determinant).isZero;
+        }
+
+        expr point(const value &argument) const
+        {
+            if (argument.isLine)
+                fail("expected a point, not a line");
+            return argument.point;
+        }
+
+        line straight(const value &argument) const
+        {
+            if (!argument.isLine)
+                fail("expected a line, not a point");
+            return argument.straight;
+        }
+
+        // name(arguments) covering the whole text, the arguments are evaluated
+        std::vector<value> call(std::string_view text, std::string_view &name)
+        {
+            const size_t open = text.find('(');
+            name = trim(text.substr(0, open));
+            if (open == std::string_view::npos || text.back() != ')')
+                fail("expected " + std::string(name) + "(...)");
+            std::vector<value> arguments;
+            int depth = 0;
+            size_t start = open + 1;
+            for (size_t i = start; i < text.size(); ++i)
+            {
+                if (text[i] == '(')
+                    ++depth;
+                else if (text[i] == ')' && depth-- == 0)
+                {
+                    if (i != text.size() - 1)
+                        fail("unexpected text after " + std::string(name) + "(...)");
+                    if (!trim(text.substr(start, i - start)).empty() || !arguments.empty())
+                        arguments.push_back(evaluate(text.substr(start, i - start)));
+                }
+                else if (text[i] == ',' && depth == 0)
+                {
+                    arguments.push_back(evaluate(text.substr(start, i - start)));
+                    start = i + 1;
+                }
+            }
+            if (depth >= 0)
+                fail("unbalanced brackets");
+            return arguments;
+        }
+
+        value evaluate(std::string_view text)
+        {
+            text = trim(text);
+            const size_t nameEnd = std::find_if_not(text.begin(), text.end(), isNameChar) - text.begin();
+            const std::string_view head = text.substr(0, nameEnd);
+            if (nameEnd == text.size())
+            {
+                auto found = lines.find(head);
+                if (found != lines.end())
+                    return {nullptr, found->second, true};
+            }
+            value made;
+            if (construct(head, text, made))
+                return made;
+            rejectUnknownCalls(text);
+            try
+            {
+                return {parser.parse(text)};
+            }
+            catch (const parseError &error)
+            {
+                fail(error.what());
+            }
+        }
+
+        // a name that is neither declared nor assigned is taken as a unit term, so a misspelled construction
+        // would silently multiply its arguments: a name right before a bracket must be known
+        void rejectUnknownCalls(std::string_view text) const
+        {
+            for (size_t start = 0; start < text.size();)
+            {
+                if (!isNameChar(text[start]))
+                {
+                    ++start;
+                    continue;
+                }
+                const size_t end = std::find_if_not(text.begin() + start, text.end(), isNameChar) - text.begin();
+                const std::string_view name = text.substr(start, end - start);
+                const size_t next = text.find_first_not_of(" \t", end);
+                if (!std::isdigit(static_cast<unsigned char>(name.front())) && next != std::string_view::npos && text[next] == '(' &&
+                    name != "conj" && !known.count(name))
+                    fail("unknown construction " + std::string(name));
+                start = end;
+            }
+        }
+
+        // calls of the constructions, false if the text is not one
+        bool construct(std::string_view head, std::string_view text, value &made)
+        {
+            static const std::map<std::string_view, size_t, std::less<>> arity = {
+                {"middlepoint", 2}, {"barycenter", 3}, {"symm", 2}, {"rotate90", 2}, {"rot_homothety", 3},
+                {"intersect", 2}, {"chord", 2}, {"tangent", 1}, {"by_two", 2}};
+            auto known = arity.find(head);
+            if (known == arity.end() || trim(text.substr(head.size())).substr(0, 1) != "(")
+                return false;
+            std::string_view name;
+            const std::vector<value> a = call(text, name);
+            if (a.size() != known->second)
+                fail(std::string(name) + " takes " + std::to_string(known->second) + " arguments");
+            if (name == "middlepoint")
+                made = {middlepoint(point(a[0]), point(a[1]))};
+            else if (name == "barycenter")
+                made = {barycenter(point(a[0]), point(a[1]), point(a[2]))};
+            else if (name == "symm")
+                made = {symm(point(a[0]), point(a[1]))};
+            else if (name == "rotate90")
+                made = {rotate90(point(a[0]), point(a[1]))};
+            else if (name == "rot_homothety")
+                made = {rot_homothety(point(a[0]), point(a[1]), point(a[2]))};
+            else if (name == "intersect")
+            {
+                if (vanishes(parallelism(straight(a[0]), straight(a[1]))))
+                    fail("intersect of parallel or equal lines");
+                made = {intersect(straight(a[0]), straight(a[1]))};
+            }
+            else if (name == "chord")
+                made = {nullptr, chord(point(a[0]), point(a[1])), true};
+            else if (name == "tangent")
+                made = {nullptr, tangent(point(a[0])), true};
+            else
+                made = {nullptr, by_two(point(a[0]), point(a[1])), true};
+            return true;
+        }
+    };
+}
+
+theoremResult calc::runTheorem(std::istream &script, const theoremOptions &options)
+{
+    const auto start = std::chrono::steady_clock::now();
+    theoremResult result;
+    metrics counters;
+    {
+        std::optional<metrics::scope> counting;
+        if (options.collectMetrics)
+            counting.emplace(counters);
+        nodeCache shared;
+        nodeCache::scope sharing(shared);
+        std::optional<resultCache::scope> persisting;
+        if (options.cache)
+            persisting.emplace(*options.cache);
+        interpreter run(options);
+        std::string text;
+        try
+        {
+            for (size_t number = 1; std::getline(script, text); ++number)
+                run.statement(text, number);
+            if (!run.checks)
+                throw std::runtime_error("no checks");
+            result.holds = run.holds;
+        }
+        catch (const std::exception &error)
+        {
+            result.error = error.what();
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.metrics = counters.report();
+    return result;
+}
+
+std::vector<theoremResult> calc::runTheoremDirectory(const std::string &directory, const theoremOptions &options)
+{
+    std::vector<std::filesystem::path> files;
+    for (const auto &entry : std::filesystem::directory_iterator(directory))
+        if (entry.is_regular_file() && entry.path().extension() == ".thm")
+            files.push_back(entry.path());
+    std::sort(files.begin(), files.end());
+
+    std::vector<theoremResult> results(files.size());
+    const unsigned workers = threadCount();
+    std::vector<std::unique_ptr<arena>> arenas;
+    for (unsigned i = 0; i < workers; ++i)
+        arenas.push_back(std::make_unique<arena>());
+    std::atomic<size_t> next{0};
+    parallelFor(workers, [&](size_t worker)
+                {
+                    for (size_t file = next++; file < files.size(); file = next++)
+                    {
+                        arena::scope query(*arenas[worker]);
+                        std::ifstream script(files[file]);
+                        if (script)
+                            results[file] = runTheorem(script, options);
+                        else
+                            results[file].error = "cannot open the file";
+                        results[file].name = files[file].filename().string();
+                    } });
+    return results;
+}
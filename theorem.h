@@ -0,0 +1,47 @@
+#pragma once
+
+#include "metrics.h"
+#include "resultcache.h"
+#include "zerotest.h"
+
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace calc
+{
+    // theorem scripts, one statement per line, "#" starts a comment:
+    //   unit a, b, c                  declares terms, also real and plain; undeclared names are unit terms
+    //   X = <value>                   names a point or a line
+    //   collinear(<p>, <p>, <p>)      a check, also concurrent(<line>, <line>, <line>) and equal(<p>, <p>)
+    // a value is a call of a construction from construction.h
+    //   middlepoint(p, p)  barycenter(p, p, p)  symm(p, p)  rotate90(p, p)  rot_homothety(p, p, p)
+    //   intersect(line, line)  chord(p, p)  tangent(p)  by_two(p, p)
+    // a line name, or an expression over points and terms (see parser.h) where i is the imaginary unit;
+    // a name right before a bracket must be declared or assigned, so a misspelled construction is an error
+    // intersect() of parallel lines is an error, so is a script without checks
+    // the theorem holds if every check holds
+    struct theoremOptions
+    {
+        bool fastChecks = false; // checks are evaluated at random points (see zerotest.h)
+        zeroTestOptions fastCheckOptions;
+        bool collectMetrics = false; // fills theoremResult::metrics (see metrics.h)
+        resultCache *cache = nullptr; // expansions are looked up and kept there (see resultcache.h)
+    };
+
+    struct theoremResult
+    {
+        std::string name;
+        bool holds = false;
+        std::string error; // empty unless the script could not be run
+        double seconds = 0;
+        metricsReport metrics;
+    };
+
+    // runs a script in the arena and node cache active on the calling thread
+    theoremResult runTheorem(std::istream &script, const theoremOptions &options = {});
+
+    // runs every *.thm file of a directory on the worker pool (see parallel.h), each in its own arena,
+    // results come back sorted by file name; throws std::filesystem::filesystem_error if it cannot be listed
+    std::vector<theoremResult> runTheoremDirectory(const std::string &directory, const theoremOptions &options = {});
+}
@@ -0,0 +1,463 @@
+#include "zerotest.h"
+
+#include "calculator.h"
+#include "gcd.h"
+#include "modular.h"
+#include "rational.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace calc;
+
+namespace
+{
+    // a point hitting a vanishing denominator is redrawn this many times before giving up
+    constexpr unsigned maxRedraws = 16;
+    constexpr unsigned maxTrials = 64;
+
+    using operationType = operationNode::operationType;
+
+    // degree bounds of the numerator and the denominator of the rational function an expression denotes
+    class degreeBound
+    {
+    public:
+        std::pair<double, double> of(const expressionNode *node)
+        {
+            auto found = memo.find(node);
+            if (found != memo.end())
+                return found->second;
+            std::pair<double, double> bound;
+            if (const polyNode *poly = dynamic_cast<const polyNode *>(node))
+            {
+                // negative exponents move to the common denominator, the product of every slot
+                // to its deepest negative power: a^-1 + b^-1 has the denominator ab
+                double positive = 0, negative = 0;
+                std::vector<int> deepest;
+                for (size_t i = 0; i < poly->size(); ++i)
+                {
+                    double up = 0;
+                    poly->powersAt(i).forEach([&](unsigned slot, int power)
+                                              {
+                                                  if (power > 0)
+                                                      up += power;
+                                                  else
+                                                  {
+                                                      if (slot >= deepest.size())
+                                                          deepest.resize(slot + 1, 0);
+                                                      deepest[slot] = std::max(deepest[slot], -power);
+                                                  } });
+                    positive = std::max(positive, up);
+                }
+                for (int power : deepest)
+                    negative += power;
+                bound = {positive + negative, negative};
+            }
+            else
+            {
+                const operationNode *op = static_cast<const operationNode *>(node);
+                const auto [n1, d1] = of(op->leftOperand());
+                const auto [n2, d2] = of(op->rightOperand());
+                switch (op->type())
+                {
+                case operationType::ADDITION:
+                    bound = {std::max(n1 + d2, n2 + d1), d1 + d2};
+                    break;
+                case operationType::MULTIPLICATION:
+                    bound = {n1 + n2, d1 + d2};
+                    break;
+                case operationType::DIVISION:
+                    bound = {n1 + d2, d1 + n2};
+                    break;
+                }
+            }
+            return memo[node] = bound;
+        }
+
+    private:
+        std::unordered_map<const expressionNode *, std::pair<double, double>> memo;
+    };
+
+    // value of an expression at one random point modulo p
+    class pointEvaluation
+    {
+    public:
+        pointEvaluation(uint32_t _p, std::mt19937_64 &_random)
+            : p(_p), random(_random)
+        {
+        }
+
+        bool singular = false; // some denominator vanished at the point
+
+        constTy evaluate(const expressionNode *node)
+        {
+            auto found = memo.find(node);
+            if (found != memo.end())
+                return found->second;
+            constTy value = 0;
+            if (const polyNode *poly = dynamic_cast<const polyNode *>(node))
+            {
+                for (size_t i = 0; i < poly->size(); ++i)
+                {
+                    constTy product = reduceMod(poly->coefAt(i), p);
+                    poly->powersAt(i).forEach([&](unsigned slot, int power)
+                                              { product = mulMod(product, powMod(slotValue(slot), power, p), p); });
+                    value = constTy(reduceMod(int64_t(value.real()) + product.real(), p),
+                                    reduceMod(int64_t(value.imag()) + product.imag(), p));
+                }
+            }
+            else
+            {
+                const operationNode *op = static_cast<const operationNode *>(node);
+                const constTy left = evaluate(op->leftOperand());
+                const constTy right = evaluate(op->rightOperand());
+                switch (op->type())
+                {
+                case operationType::ADDITION:
+                    value = constTy(reduceMod(int64_t(left.real()) + right.real(), p),
+                                    reduceMod(int64_t(left.imag()) + right.imag(), p));
+                    break;
+                case operationType::MULTIPLICATION:
+                    value = mulMod(left, right, p);
+                    break;
+                case operationType::DIVISION:
+                    if (right == constTy(0))
+                        singular = true;
+                    else
+                        value = mulMod(left, inverseMod(right, p), p);
+                    break;
+                }
+            }
+            return memo[node] = value;
+        }
+
+    private:
+        // every slot is drawn once per point, nonzero so that negative exponents stay defined
+        constTy slotValue(unsigned slot)
+        {
+            if (slot >= values.size())
+                values.resize(slot + 1, constTy(0));
+            while (values[slot] == constTy(0))
+                values[slot] = constTy(int(random() % p), int(random() % p));
+            return values[slot];
+        }
+
+        const uint32_t p;
+        std::mt19937_64 &random;
+        std::vector<constTy> values;
+        std::unordered_map<const expressionNode *, constTy> memo;
+    };
+
+    // a sum met on many paths of a shared tree is walked once per path, past this many addends the expression stays whole
+    constexpr size_t maxAddends = size_t(1) << 12;
+
+    polyNode one()
+    {
+        return polyNode(monomial(1, exponentVector()));
+    }
+
+    bool isOne(const polyNode &a)
+    {
+        return a.size() == 1 && a.powersAt(0).empty() && a.coefAt(0) == constTy(1);
+    }
+
+    bool isMonomial(const expressionNode *node)
+    {
+        const polyNode *poly = dynamic_cast<const polyNode *>(node);
+        return poly && poly->size() == 1;
+    }
+
+    // an expression as a sum of products, factors below a division line are kept apart
+    class sumOfProducts
+    {
+    public:
+        struct addend
+        {
+            std::vector<const expressionNode *> upper, lower;
+        };
+
+        explicit sumOfProducts(const expressionNode *expression)
+        {
+            sum(expression, {});
+            if (addends.size() > maxAddends)
+                addends = {addend{{expression}, {}}};
+        }
+
+        std::vector<addend> addends;
+
+    private:
+        void sum(const expressionNode *node, std::vector<const expressionNode *> carried)
+        {
+            if (addends.size() > maxAddends)
+                return;
+            if (const operationNode *op = dynamic_cast<const operationNode *>(node))
+            {
+                if (op->type() == operationType::ADDITION)
+                {
+                    sum(op->leftOperand(), carried);
+                    sum(op->rightOperand(), carried);
+                    return;
+                }
+                // a monomial is carried into the sum it multiplies, so that sum is sliced rather than expanded
+                if (op->type() == operationType::MULTIPLICATION)
+                    for (const auto &[scale, rest] : {std::pair(op->leftOperand(), op->rightOperand()), std::pair(op->rightOperand(), op->leftOperand())})
+                        if (isMonomial(scale))
+                        {
+                            carried.push_back(scale);
+                            sum(rest, carried);
+                            return;
+                        }
+            }
+            addend made;
+            made.upper = carried;
+            product(node, made, false);
+            addends.push_back(std::move(made));
+        }
+
+        static void product(const expressionNode *node, addend &into, bool below)
+        {
+            const operationNode *op = dynamic_cast<const operationNode *>(node);
+            if (op && op->type() != operationType::ADDITION)
+            {
+                product(op->leftOperand(), into, below);
+                product(op->rightOperand(), into, below != (op->type() == operationType::DIVISION));
+                return;
+            }
+            (below ? into.lower : into.upper).push_back(node);
+        }
+    };
+
+    // grade of a monomial: its total degree, or the exponent of one slot; both add up under multiplication
+    struct grading
+    {
+        int slot = -1; // -1 for the total degree
+
+        int of(const exponentVector &powers) const { return slot < 0 ? powers.totalDegree() : powers[unsigned(slot)]; }
+    };
+
+    // the spread of grades of a product is the sum over its factors, the grading with the widest spread is taken
+    grading finest(const std::vector<std::vector<polyNode>> &numerators)
+    {
+        std::map<int, long> widest;
+        for (const std::vector<polyNode> &factors : numerators)
+        {
+            std::map<int, long> spread;
+            for (const polyNode &factor : factors)
+            {
+                struct range
+                {
+                    int low = 0, high = 0;
+                    size_t count = 0;
+                };
+                std::map<int, range> ranges;
+                for (size_t i = 0; i < factor.size(); ++i)
+                {
+                    auto widen = [&](int slot, int grade)
+                    {
+                        range &r = ranges[slot];
+                        r.low = r.count ? std::min(r.low, grade) : grade;
+                        r.high = r.count ? std::max(r.high, grade) : grade;
+                        ++r.count;
+                    };
+                    widen(-1, factor.powersAt(i).totalDegree());
+                    factor.powersAt(i).forEach([&](unsigned slot, int power)
+                                               { widen(int(slot), power); });
+                }
+                for (auto &[slot, r] : ranges)
+                {
+                    // monomials without the slot have grade 0 in it
+                    if (slot >= 0 && r.count < factor.size())
+                        r = {std::min(r.low, 0), std::max(r.high, 0), r.count};
+                    spread[slot] += r.high - r.low;
+                }
+            }
+            for (const auto &[slot, width] : spread)
+                widest[slot] = std::max(widest[slot], width);
+        }
+        grading best;
+        long bestWidth = -1;
+        for (const auto &[slot, width] : widest)
+            if (width > bestWidth)
+            {
+                best.slot = slot;
+                bestWidth = width;
+            }
+        return best;
+    }
+
+    std::map<int, polyNode> slices(const polyNode &poly, grading by)
+    {
+        std::map<int, std::vector<monomial>> parts;
+        for (size_t i = 0; i < poly.size(); ++i)
+            parts[by.of(poly.powersAt(i))].push_back(poly.at(i));
+        std::map<int, polyNode> result;
+        for (auto &[grade, terms] : parts)
+            result.emplace(grade, polyNode::collect(std::move(terms)));
+        return result;
+    }
+
+    // factors dealt largest first to the half with fewer monomials so far, counted as a product of sizes
+    std::pair<polyNode, polyNode> halves(std::vector<polyNode> factors)
+    {
+        std::sort(factors.begin(), factors.end(), [](const polyNode &a, const polyNode &b)
+                  { return a.size() > b.size(); });
+        polyNode first = one(), second = one();
+        double firstSize = 0, secondSize = 0; // logarithms
+        for (const polyNode &factor : factors)
+        {
+            if (firstSize <= secondSize)
+            {
+                first = first * factor;
+                firstSize += std::log(double(factor.size()));
+            }
+            else
+            {
+                second = second * factor;
+                secondSize += std::log(double(factor.size()));
+            }
+        }
+        return {first, second};
+    }
+}
+
+zeroTestResult calc::probablyZero(const expressionNode *expression, const zeroTestOptions &options)
+{
+    std::mt19937_64 random(options.seed ? options.seed : std::random_device()());
+    const std::vector<uint32_t> &primes = modularPrimes();
+
+    // a nonzero numerator of degree d vanishes at a random point of Z_p[i] with probability at most d / p^2
+    const double degree = degreeBound().of(expression).first;
+    double errorProbability = 1;
+    unsigned trials = 0;
+    while (trials < maxTrials && (trials < options.trials || errorProbability > options.errorBound))
+    {
+        const uint32_t p = primes[random() % primes.size()];
+        unsigned redraws = 0;
+        for (;; ++redraws)
+        {
+            // a denominator vanishing at every point is most likely zero
+            if (redraws == maxRedraws)
+                throw std::domain_error("probablyZero: every point hits a vanishing denominator");
+            pointEvaluation point(p, random);
+            const constTy value = point.evaluate(expression);
+            if (point.singular)
+                continue;
+            if (value != constTy(0))
+                return {false, 0, trials + 1};
+            break;
+        }
+        ++trials;
+        errorProbability *= std::min(1.0, degree / (double(p) * p));
+    }
+    return {true, errorProbability, trials};
+}
+
+sliceTestResult calc::slicedZero(const expressionNode *expression)
+{
+    std::unordered_map<const expressionNode *, rationalFunction> expanded;
+    auto expansion = [&](const expressionNode *node) -> const rationalFunction &
+    {
+        auto found = expanded.find(node);
+        if (found == expanded.end())
+            found = expanded.emplace(node, rationalFunction::ofExpansion(const_cast<expressionNode *>(node)->expand())).first;
+        return found->second;
+    };
+
+    // every addend as factors of its numerator over a denominator without monomial factors
+    std::vector<std::vector<polyNode>> numerators;
+    std::vector<polyNode> denominators;
+    for (const sumOfProducts::addend &part : sumOfProducts(expression).addends)
+    {
+        std::vector<polyNode> factors;
+        polyNode denominator = one();
+        for (const expressionNode *node : part.lower)
+        {
+            const rationalFunction &divisor = expansion(node);
+            if (divisor.checkZeroEquality())
+                throw std::domain_error("slicedZero: division by zero");
+            if (!divisor.isPolynomial())
+                factors.push_back(divisor.denominator());
+            denominator = denominator * divisor.numerator();
+        }
+        bool vanishes = false;
+        for (const expressionNode *node : part.upper)
+        {
+            const rationalFunction &factor = expansion(node);
+            vanishes |= factor.checkZeroEquality();
+            factors.push_back(factor.numerator());
+            if (!factor.isPolynomial())
+                denominator = denominator * factor.denominator();
+        }
+        if (vanishes)
+            continue;
+        // monomials are units of Laurent polynomials, they move up as negative exponents
+        const exponentVector shift = exponentVector() / monomialContent(denominator);
+        if (!shift.empty())
+        {
+            factors.push_back(polyNode(monomial(1, shift)));
+            denominator = denominator * monomial(1, shift);
+        }
+        numerators.push_back(std::move(factors));
+        denominators.push_back(std::move(denominator));
+    }
+
+    // the addends are brought to a common multiple of their denominators
+    polyNode common = one();
+    for (const polyNode &denominator : denominators)
+    {
+        polyNode missing;
+        if (!divideExact(denominator, gcd(common, denominator), missing))
+            throw std::logic_error("slicedZero: gcd does not divide");
+        common = common * missing;
+    }
+    if (!isOne(common))
+        for (size_t i = 0; i < numerators.size(); ++i)
+        {
+            polyNode scale;
+            if (!divideExact(common, denominators[i], scale))
+                throw std::logic_error("slicedZero: not a common multiple");
+            numerators[i].push_back(scale);
+        }
+
+    const grading by = finest(numerators);
+    std::vector<std::pair<std::map<int, polyNode>, std::map<int, polyNode>>> sliced;
+    std::map<int, double> cost; // monomial products of a slice of the numerator
+    for (std::vector<polyNode> &factors : numerators)
+    {
+        const auto [first, second] = halves(std::move(factors));
+        sliced.emplace_back(slices(first, by), slices(second, by));
+        for (const auto &[i, a] : sliced.back().first)
+            for (const auto &[j, b] : sliced.back().second)
+                cost[i + j] += double(a.size()) * b.size();
+    }
+    std::vector<std::pair<double, int>> order;
+    for (const auto &[grade, products] : cost)
+        order.push_back({products, grade});
+    std::sort(order.begin(), order.end());
+
+    sliceTestResult result{true, unsigned(order.size()), 0};
+    for (const auto &[products, grade] : order)
+    {
+        ++result.checked;
+        polyNode slice;
+        for (const auto &[first, second] : sliced)
+            for (const auto &[i, a] : first)
+            {
+                auto b = second.find(grade - i);
+                if (b != second.end())
+                    slice = slice + a * b->second;
+            }
+        if (!slice.checkZeroEquality())
+        {
+            result.isZero = false;
+            return result;
+        }
+    }
+    return result;
+}
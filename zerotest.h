@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+namespace calc
+{
+    class expressionNode;
+
+    struct zeroTestOptions
+    {
+        unsigned trials = 2;       // independent evaluations to run at least
+        double errorBound = 1e-12; // more trials are run until a false "zero" is less likely than this
+        uint64_t seed = 0;         // 0 draws a fresh seed
+    };
+
+    struct zeroTestResult
+    {
+        bool isZero;             // "nonzero" is certain, "zero" holds up to errorProbability
+        double errorProbability;
+        unsigned trials;
+    };
+
+    // Schwartz-Zippel test: the unexpanded expression is evaluated at random points of Z_p[i]
+    // for random primes p from modularPrimes(), shared subexpressions are evaluated once per point
+    // every exponent slot gets an independent value, so x and conj(x) are independent for plain terms,
+    // real terms are their own conjugate and conj(u) = 1/u is the modular inverse for unit terms
+    // throws std::domain_error if every point drawn for a trial hits a vanishing denominator
+    zeroTestResult probablyZero(const expressionNode *expression, const zeroTestOptions &options = {});
+
+    struct sliceTestResult
+    {
+        bool isZero;      // exact
+        unsigned slices;  // of the numerator
+        unsigned checked; // built before the answer was known
+    };
+
+    // exact test that builds the expanded numerator one slice at a time and stops at the first nonzero slice
+    // the expression is taken as a sum of products of expanded factors over a common denominator;
+    // the numerator is graded by total degree or by the exponent of one slot, whichever gives more slices,
+    // and every addend is split into two halves multiplied slice by slice, cheapest slice first,
+    // so memory holds the halves and one slice rather than the whole numerator
+    // throws std::domain_error on a division by zero, like expand()
+    sliceTestResult slicedZero(const expressionNode *expression);
+}